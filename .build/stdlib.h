@@ -0,0 +1,9 @@
+#ifndef STDLIB_HEADER__
+#define STDLIB_HEADER__
+
+/* this code was generated using the "script" create_stdlib_header.c */
+/* look at programs/stdlib.deeprose for original program */
+
+const char stdlib[] = {10, 40, 100, 101, 102, 32, 116, 114, 117, 101, 32, 49, 41, 10, 40, 100, 101, 102, 32, 102, 97, 108, 115, 101, 32, 39, 40, 41, 41, 10, 40, 100, 101, 102, 32, 111, 116, 104, 101, 114, 119, 105, 115, 101, 32, 116, 114, 117, 101, 41, 10, 10, 40, 100, 101, 102, 32, 100, 101, 99, 32, 40, 92, 32, 40, 110, 41, 32, 40, 45, 32, 110, 32, 49, 41, 41, 41, 10, 40, 100, 101, 102, 32, 105, 110, 99, 32, 40, 92, 32, 40, 110, 41, 32, 40, 43, 32, 49, 32, 110, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 110, 105, 108, 63, 32, 40, 92, 32, 40, 120, 115, 41, 32, 40, 61, 32, 110, 105, 108, 32, 120, 115, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 108, 105, 115, 116, 32, 40, 92, 32, 40, 38, 32, 120, 115, 41, 32, 120, 115, 41, 41, 10, 10, 10, 40, 100, 101, 102, 32, 122, 105, 112, 45, 119, 105, 116, 104, 32, 40, 92, 32, 40, 102, 32, 38, 32, 120, 115, 115, 41, 10, 32, 32, 32, 32, 40, 105, 102, 32, 40, 110, 111, 116, 32, 40, 97, 108, 108, 63, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 110, 111, 116, 32, 110, 105, 108, 63, 41, 32, 120, 115, 115, 41, 41, 32, 110, 105, 108, 10, 32, 32, 32, 32, 32, 32, 40, 99, 111, 110, 115, 32, 40, 97, 112, 112, 108, 121, 32, 102, 32, 40, 109, 97, 112, 32, 102, 105, 114, 115, 116, 32, 120, 115, 115, 41, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 97, 112, 112, 108, 121, 32, 122, 105, 112, 45, 119, 105, 116, 104, 32, 40, 99, 111, 110, 115, 32, 102, 32, 40, 109, 97, 112, 32, 114, 101, 115, 116, 32, 120, 115, 115, 41, 41, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 122, 105, 112, 32, 40, 92, 32, 40, 38, 32, 120, 115, 115, 41, 10, 32, 32, 32, 32, 40, 97, 112, 112, 108, 121, 32, 122, 105, 112, 45, 119, 105, 116, 104, 32, 40, 99, 111, 110, 115, 32, 108, 105, 115, 116, 32, 120, 115, 115, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 101, 118, 101, 110, 63, 32, 40, 92, 32, 40, 110, 41, 32, 40, 61, 32, 40, 109, 111, 100, 32, 110, 32, 50, 41, 32, 48, 41, 41, 41, 10, 40, 100, 101, 102, 32, 111, 100, 100, 63, 32, 40, 92, 32, 40, 110, 41, 32, 40, 110, 111, 116, 32, 40, 101, 118, 101, 110, 63, 32, 110, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 115, 117, 109, 32, 40, 92, 32, 40, 120, 115, 41, 32, 40, 97, 112, 112, 108, 121, 32, 43, 32, 120, 115, 41, 41, 41, 10, 40, 100, 101, 102, 32, 112, 114, 111, 100, 117, 99, 116, 32, 40, 92, 32, 40, 120, 115, 41, 32, 40, 97, 112, 112, 108, 121, 32, 42, 32, 120, 115, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 62, 61, 32, 40, 92, 32, 40, 38, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 108, 101, 116, 32, 40, 62, 61, 94, 32, 40, 92, 32, 40, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 111, 114, 32, 40, 62, 32, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 61, 32, 97, 32, 98, 41, 41, 41, 41, 10, 32, 32, 32, 32, 32, 32, 40, 97, 108, 108, 63, 32, 40, 92, 32, 40, 120, 41, 32, 40, 62, 61, 94, 32, 40, 99, 97, 114, 32, 120, 41, 32, 40, 99, 97, 100, 114, 32, 120, 41, 41, 41, 32, 40, 122, 105, 112, 32, 120, 115, 32, 40, 100, 114, 111, 112, 32, 49, 32, 120, 115, 41, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 60, 61, 32, 40, 92, 32, 40, 38, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 108, 101, 116, 32, 40, 60, 61, 94, 32, 40, 92, 32, 40, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 111, 114, 32, 40, 60, 32, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 61, 32, 97, 32, 98, 41, 41, 41, 41, 10, 32, 32, 32, 32, 32, 32, 40, 97, 108, 108, 63, 32, 40, 92, 32, 40, 120, 41, 32, 40, 60, 61, 94, 32, 40, 99, 97, 114, 32, 120, 41, 32, 40, 99, 97, 100, 114, 32, 120, 41, 41, 41, 32, 40, 122, 105, 112, 32, 120, 115, 32, 40, 100, 114, 111, 112, 32, 49, 32, 120, 115, 41, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 94, 32, 40, 92, 32, 40, 98, 97, 115, 101, 32, 110, 41, 10, 32, 32, 32, 32, 40, 105, 102, 32, 40, 61, 32, 110, 32, 48, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 49, 10, 32, 32, 32, 32, 32, 32, 32, 32, 40, 42, 32, 98, 97, 115, 101, 32, 40, 94, 32, 98, 97, 115, 101, 32, 40, 100, 101, 99, 32, 110, 41, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 109, 97, 120, 32, 40, 92, 32, 40, 120, 32, 38, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 108, 101, 116, 32, 40, 109, 97, 120, 94, 32, 40, 92, 32, 40, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 105, 102, 32, 40, 62, 32, 97, 32, 98, 41, 32, 97, 32, 98, 41, 41, 41, 10, 32, 32, 32, 32, 32, 32, 40, 102, 111, 108, 100, 114, 32, 109, 97, 120, 94, 32, 120, 32, 120, 115, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 109, 105, 110, 32, 40, 92, 32, 40, 120, 32, 38, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 108, 101, 116, 32, 40, 109, 105, 110, 94, 32, 40, 92, 32, 40, 97, 32, 98, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 105, 102, 32, 40, 60, 32, 97, 32, 98, 41, 32, 97, 32, 98, 41, 41, 41, 10, 32, 32, 32, 32, 32, 32, 40, 102, 111, 108, 100, 114, 32, 109, 105, 110, 94, 32, 120, 32, 120, 115, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 99, 111, 109, 112, 111, 115, 101, 32, 40, 92, 32, 40, 38, 32, 102, 115, 41, 10, 32, 32, 32, 32, 40, 92, 32, 40, 120, 41, 10, 32, 32, 32, 32, 32, 32, 40, 102, 111, 108, 100, 114, 32, 40, 92, 32, 40, 102, 32, 120, 41, 32, 40, 102, 32, 120, 41, 41, 32, 120, 32, 102, 115, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 102, 111, 114, 45, 101, 97, 99, 104, 32, 40, 92, 32, 40, 102, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 97, 110, 100, 32, 120, 115, 10, 32, 32, 32, 32, 32, 32, 32, 32, 40, 100, 111, 32, 40, 102, 32, 40, 102, 105, 114, 115, 116, 32, 120, 115, 41, 41, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 102, 111, 114, 45, 101, 97, 99, 104, 32, 102, 32, 40, 114, 101, 115, 116, 32, 120, 115, 41, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 110, 101, 120, 116, 32, 40, 92, 32, 40, 120, 115, 41, 10, 32, 32, 32, 32, 40, 102, 105, 114, 115, 116, 32, 40, 114, 101, 115, 116, 32, 120, 115, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 100, 114, 111, 112, 45, 117, 110, 116, 105, 108, 32, 40, 92, 32, 40, 102, 32, 120, 115, 41, 10, 32, 32, 32, 32, 40, 99, 111, 110, 100, 32, 40, 110, 105, 108, 63, 32, 120, 115, 41, 32, 110, 105, 108, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 40, 102, 32, 40, 102, 105, 114, 115, 116, 32, 120, 115, 41, 41, 32, 120, 115, 10, 32, 32, 32, 32, 32, 32, 32, 32, 32, 32, 111, 116, 104, 101, 114, 119, 105, 115, 101, 32, 40, 100, 114, 111, 112, 45, 117, 110, 116, 105, 108, 32, 102, 32, 40, 114, 101, 115, 116, 32, 120, 115, 41, 41, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 45, 62, 32, 40, 92, 32, 40, 120, 32, 38, 32, 102, 115, 41, 10, 32, 32, 32, 32, 40, 102, 111, 108, 100, 108, 32, 40, 92, 32, 40, 102, 32, 120, 41, 32, 40, 102, 32, 120, 41, 41, 32, 120, 32, 102, 115, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 116, 121, 112, 101, 45, 105, 115, 63, 32, 40, 92, 32, 40, 101, 120, 112, 114, 32, 116, 41, 32, 40, 61, 32, 40, 116, 121, 112, 101, 45, 111, 102, 32, 101, 120, 112, 114, 41, 32, 116, 41, 41, 41, 10, 10, 40, 100, 101, 102, 32, 99, 97, 114, 32, 102, 105, 114, 115, 116, 41, 10, 40, 100, 101, 102, 32, 99, 100, 114, 32, 114, 101, 115, 116, 41, 10, 10, 40, 100, 101, 102, 32, 99, 97, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 100, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 97, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 100, 114, 41, 41, 10, 10, 40, 100, 101, 102, 32, 99, 97, 97, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 97, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 97, 97, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 97, 114, 32, 99, 100, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 97, 100, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 100, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 97, 100, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 97, 114, 32, 99, 100, 114, 32, 99, 100, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 97, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 97, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 97, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 97, 114, 32, 99, 100, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 100, 97, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 100, 114, 32, 99, 97, 114, 41, 41, 10, 40, 100, 101, 102, 32, 99, 100, 100, 100, 114, 32, 40, 99, 111, 109, 112, 111, 115, 101, 32, 99, 100, 114, 32, 99, 100, 114, 32, 99, 100, 114, 41, 41, 10, 10, 40, 100, 101, 102, 32, 99, 111, 110, 115, 116, 32, 40, 92, 32, 40, 118, 97, 108, 41, 10, 32, 32, 32, 32, 40, 92, 32, 40, 38, 32, 100, 117, 109, 109, 121, 41, 32, 118, 97, 108, 41, 41, 41, 10, 10, 0};
+
+#endif
@@ -1,17 +1,35 @@
 #include "arena.h"
 #include <stdlib.h>
+#include <stdbool.h>
 #include "util.h"
 
+#define _ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+/* the first chunk goes right after the arena */
+#define ARENA_HEADER_SIZE _ALIGN_UP(sizeof(Arena))
+
+static ArenaChunk *_arena_chunk_init(void *mem, size_t capacity)
+{
+    ArenaChunk *chunk = mem;
+    *chunk = (ArenaChunk) {
+        .next = NULL,
+        .cursor = 0,
+        .capacity = capacity,
+    };
+    return chunk;
+}
+
 Arena *arena_new(size_t capacity)
 {
     if (capacity == 0) capacity = ARENA_DEFAULT_SIZE;
-    Arena *ret = malloc(sizeof(Arena) + sizeof(unit) * capacity);
+    capacity = _ALIGN_UP(capacity);
+    Arena *ret = malloc(ARENA_HEADER_SIZE + sizeof(ArenaChunk) + sizeof(unit) * capacity);
     CHECK_ALLOC(ret);
 
+    ArenaChunk *first = _arena_chunk_init((unit *)ret + ARENA_HEADER_SIZE, capacity);
     *ret = (Arena) {
-        .cursor = 0,
-        .capacity = capacity,
-        .next = NULL,
+        .first = first,
+        .current = first,
+        .allocations = 0,
     };
 
     return ret;
@@ -20,28 +38,78 @@ Arena *arena_new(size_t capacity)
 
 void arena_destroy(Arena *a)
 {
-    if (a->next) arena_destroy(a->next);
+    ArenaChunk *chunk = a->first->next;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
     free(a);
 }
 
-void *arena_alloc(Arena *a, size_t size)
+/* moves on to the chunk after the current one, if there is one with
+ * enough room, otherwise a new one goes in between */
+static ArenaChunk *_arena_next_chunk(Arena *a, size_t size)
 {
-    if (a->capacity <= a->cursor + size) {
-        if (a->next) return arena_alloc(a->next, size);
-        else {
-            a->next = arena_new(a->capacity + size);
-            return arena_alloc(a->next, size);
-        }
-    } else {
-        void *ptr = &a->pool[a->cursor];
-        a->cursor += size;
-        return ptr;
+    ArenaChunk *next = a->current->next;
+    if (next == NULL || next->capacity < size) {
+        size_t capacity = a->current->capacity * 2;
+        if (capacity > ARENA_MAX_CHUNK_SIZE) capacity = ARENA_MAX_CHUNK_SIZE;
+        if (capacity < size) capacity = size;
+
+        ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + sizeof(unit) * capacity);
+        CHECK_ALLOC(chunk);
+        _arena_chunk_init(chunk, capacity);
+        chunk->next = next;
+        a->current->next = chunk;
+        next = chunk;
     }
+
+    next->cursor = 0;
+    a->current = next;
+    return next;
+}
+
+void *arena_alloc(Arena *a, size_t size)
+{
+    size = _ALIGN_UP(size);
+    ArenaChunk *chunk = a->current;
+    if (chunk->capacity - chunk->cursor < size) chunk = _arena_next_chunk(a, size);
+
+    void *ptr = &chunk->pool[chunk->cursor];
+    chunk->cursor += size;
+    a->allocations++;
+    return ptr;
 }
 
 /* clears the arena for reuse */
 void arena_clear(Arena *a)
 {
-   a->cursor = 0;
-   if (a->next) arena_clear(a->next);
+    a->current = a->first;
+    a->first->cursor = 0;
+    a->allocations = 0;
+}
+
+ArenaCheckpoint arena_checkpoint(Arena *a)
+{
+    return (ArenaCheckpoint) { .chunk = a->current, .cursor = a->current->cursor };
+}
+
+void arena_rewind(Arena *a, ArenaCheckpoint checkpoint)
+{
+    a->current = checkpoint.chunk;
+    a->current->cursor = checkpoint.cursor;
+}
+
+ArenaStats arena_stats(Arena *a)
+{
+    ArenaStats stats = { .chunks = 0, .capacity = 0, .used = 0, .allocations = a->allocations };
+    bool in_use = true; /* the chunks after the current one are free */
+    for (ArenaChunk *chunk = a->first; chunk; chunk = chunk->next) {
+        stats.chunks++;
+        stats.capacity += chunk->capacity;
+        if (in_use) stats.used += chunk->cursor;
+        if (chunk == a->current) in_use = false;
+    }
+    return stats;
 }
@@ -3,29 +3,57 @@
 
 #include <stddef.h>
 
-/* The arena is implemented as a super simple bump allocator, 
- * meaning no reallocs, no induvidual frees. 
- * However, when an allocation size requires more than 
- * the arena's capacity, to avoid expensive reallocs, 
- * I made a linked list sort of thingy, attaching arenas together */
+/* The arena is implemented as a super simple bump allocator,
+ * meaning no reallocs, no induvidual frees.
+ * When an allocation doesn't fit in the chunk that's being bumped, the
+ * next chunk is used, or a new one twice the size is linked in after it.
+ * Every allocation is aligned for any type (like malloc).
+ *
+ * arena_clear and arena_rewind keep the chunks around, the chunks after
+ * the current one are free and get reused before anything is malloc'd */
 
 
 typedef char unit;
 _Static_assert(sizeof(unit) == 1, "");
 
 #define ARENA_DEFAULT_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1 << 20) /* chunks stop doubling here */
+#define ARENA_ALIGN _Alignof(max_align_t)
 
-typedef struct Arena Arena;
-struct Arena {
+typedef struct ArenaChunk ArenaChunk;
+struct ArenaChunk {
+    ArenaChunk *next; /* nullable */
     size_t cursor;
     size_t capacity;
-    Arena *next; /* nullable */
-    unit pool[]; /* flexible array member */
+    _Alignas(ARENA_ALIGN) unit pool[]; /* flexible array member */
 };
 
+typedef struct Arena Arena;
+struct Arena {
+    ArenaChunk *first; /* allocated together with the arena */
+    ArenaChunk *current;
+    size_t allocations;
+};
+
+/* a point to rewind to, everything allocated after it is dropped */
+typedef struct {
+    ArenaChunk *chunk;
+    size_t cursor;
+} ArenaCheckpoint;
+
+typedef struct {
+    size_t chunks;
+    size_t capacity; /* bytes in all the chunks */
+    size_t used; /* bytes handed out, including alignment */
+    size_t allocations; /* since it was made or last cleared */
+} ArenaStats;
+
 Arena *arena_new(size_t capacity);
 void arena_destroy(Arena *a);
 void *arena_alloc(Arena *a, size_t size);
 void arena_clear(Arena *a);
+ArenaCheckpoint arena_checkpoint(Arena *a);
+void arena_rewind(Arena *a, ArenaCheckpoint checkpoint);
+ArenaStats arena_stats(Arena *a);
 
 #endif
@@ -0,0 +1,406 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "compile.h"
+#include "environment.h"
+#include "eval.h"
+#include "util.h"
+
+/* where an expression is compiled. A call in TAIL_CALL position replaces
+ * the frame of the function, a recur in TAIL_LOOP position goes back to
+ * the start of the innermost loop */
+typedef unsigned Tail;
+enum { TAIL_NONE = 0, TAIL_CALL = 1 << 0, TAIL_LOOP = 1 << 1 };
+
+/* the loop whose body is being compiled */
+typedef struct Loop Loop;
+struct Loop {
+    Object *o; /* the O_LET */
+    size_t start; /* where the body starts */
+    size_t lets; /* lets entered inside of it so far */
+    Loop *parent; /* nullable */
+};
+
+typedef struct {
+    Env *env;
+    struct { size_t len, capacity; Instr *ptr; } code;
+    struct { size_t len, capacity; Object **ptr; } constants;
+    size_t caches;
+    Loop *loop; /* nullable */
+} Compiler;
+
+static void _compile(Compiler *c, Object *o, Tail tail);
+
+static inline size_t _emit(Compiler *c, Instr instr)
+{
+    da_append(c->code, instr);
+    return c->code.len - 1;
+}
+
+static Instr _constant(Compiler *c, Object *o)
+{
+    for (size_t i = 0; i < c->constants.len; i++)
+        if (c->constants.ptr[i] == o) return (Instr)i;
+
+    da_append(c->constants, o);
+    return (Instr)(c->constants.len - 1);
+}
+
+static inline Instr _cache(Compiler *c)
+{
+    return (Instr)c->caches++;
+}
+
+/* emits a jump with a target to be filled in by _patch */
+static inline size_t _emit_jump(Compiler *c, Instr op)
+{
+    _emit(c, op);
+    return _emit(c, 0);
+}
+
+static inline void _patch(Compiler *c, size_t operand)
+{
+    c->code.ptr[operand] = (Instr)c->code.len;
+}
+
+static bool _proper_list(Object *o, size_t *len)
+{
+    *len = 0;
+    while (o->kind == O_LIST) {
+        (*len)++;
+        o = o->list.cdr;
+    }
+    return o->kind == O_NIL;
+}
+
+static inline Object *_nth(Object *list, size_t n)
+{
+    while (n--) list = list->list.cdr;
+    return list->list.car;
+}
+
+static void _compile_if(Compiler *c, Object *args, Tail tail)
+{
+    _compile(c, _nth(args, 0), TAIL_NONE);
+    size_t to_else = _emit_jump(c, OP_JUMP_IF_NIL);
+    _compile(c, _nth(args, 1), tail);
+    size_t to_end = _emit_jump(c, OP_JUMP);
+    _patch(c, to_else);
+    _compile(c, _nth(args, 2), tail);
+    _patch(c, to_end);
+}
+
+static void _compile_cond(Compiler *c, Object *args, Tail tail)
+{
+    struct { size_t len, capacity; size_t *ptr; } to_end = { 0, 4, malloc(sizeof(size_t) * 4) };
+    CHECK_ALLOC(to_end.ptr);
+
+    for (; args->kind == O_LIST; args = args->list.cdr->list.cdr) {
+        _compile(c, args->list.car, TAIL_NONE);
+        size_t to_next = _emit_jump(c, OP_JUMP_IF_NIL);
+        _compile(c, args->list.cdr->list.car, tail);
+        da_append(to_end, _emit_jump(c, OP_JUMP));
+        _patch(c, to_next);
+    }
+    _emit(c, OP_NIL);
+
+    for (size_t i = 0; i < to_end.len; i++) _patch(c, to_end.ptr[i]);
+    free(to_end.ptr);
+}
+
+static void _compile_do(Compiler *c, Object *args, Tail tail)
+{
+    if (args->kind == O_NIL) {
+        _emit(c, OP_NIL);
+        return;
+    }
+
+    for (; args->list.cdr->kind == O_LIST; args = args->list.cdr) {
+        _compile(c, args->list.car, TAIL_NONE);
+        _emit(c, OP_POP);
+    }
+    _compile(c, args->list.car, tail);
+}
+
+/* and/or: every value but the last either ends it or gets popped */
+static void _compile_and_or(Compiler *c, Object *args, Instr op, Tail tail)
+{
+    struct { size_t len, capacity; size_t *ptr; } to_end = { 0, 4, malloc(sizeof(size_t) * 4) };
+    CHECK_ALLOC(to_end.ptr);
+
+    for (; args->list.cdr->kind == O_LIST; args = args->list.cdr) {
+        _compile(c, args->list.car, TAIL_NONE);
+        da_append(to_end, _emit_jump(c, op));
+    }
+    _compile(c, args->list.car, tail);
+
+    for (size_t i = 0; i < to_end.len; i++) _patch(c, to_end.ptr[i]);
+    free(to_end.ptr);
+}
+
+static void _compile_let(Compiler *c, Object *o, Tail tail)
+{
+    struct Let *let = o->let;
+    _emit(c, OP_LET_ENTER);
+    _emit(c, _constant(c, o));
+    for (size_t i = 0; i < let->binding_count; i++) {
+        _compile(c, let->binding_values[i], TAIL_NONE);
+        _emit(c, OP_SET_LOCAL);
+        _emit(c, (Instr)let->binding_slots[i]);
+    }
+
+    if (let->loop) {
+        Loop loop = { .o = o, .start = c->code.len, .lets = 0, .parent = c->loop };
+        c->loop = &loop;
+        _compile(c, let->resolved, (tail & TAIL_CALL) | TAIL_LOOP);
+        c->loop = loop.parent;
+    } else {
+        if (c->loop) c->loop->lets++;
+        _compile(c, let->resolved, tail);
+        if (c->loop) c->loop->lets--;
+    }
+
+    /* in tail position the frame is dropped when the function returns */
+    if (!(tail & TAIL_CALL)) _emit(c, OP_LET_EXIT);
+}
+
+/* the new values are all evaluated before any of them are bound */
+static void _compile_recur(Compiler *c, Object *args)
+{
+    for (; args->kind == O_LIST; args = args->list.cdr)
+        _compile(c, args->list.car, TAIL_NONE);
+    _emit(c, OP_RECUR);
+    _emit(c, _constant(c, c->loop->o));
+    _emit(c, (Instr)c->loop->lets);
+    _emit(c, OP_JUMP);
+    _emit(c, (Instr)c->loop->start);
+}
+
+static void _compile_call(Compiler *c, Object *o, size_t argc, Tail tail)
+{
+    Object *head = o->list.car;
+    Object *name;
+    if (head->kind == O_IDENT) {
+        /* force evaluation of identifiers in function calls like clojure or scheme
+         * so this code should work:
+         * (eval (cons '+ '(1 2 3))) => 6 */
+        _emit(c, OP_GLOBAL);
+        _emit(c, _constant(c, head));
+        _emit(c, _cache(c));
+        name = head;
+    } else {
+        _compile(c, head, TAIL_NONE);
+        name = head->kind == O_LOCAL ? head->local.ident : object_string_slice_new_cstr("<anonymous>");
+    }
+
+    _emit(c, OP_PREPARE_CALL);
+    _emit(c, _constant(c, o->list.cdr));
+    size_t to_end = _emit(c, 0);
+
+    for (Object *args = o->list.cdr; args->kind == O_LIST; args = args->list.cdr)
+        _compile(c, args->list.car, TAIL_NONE);
+
+    _emit(c, tail & TAIL_CALL ? OP_TAIL_CALL : OP_CALL);
+    _emit(c, (Instr)argc);
+    _emit(c, _constant(c, name));
+    _patch(c, to_end);
+}
+
+#define FOLD_MAX_ARGS 8
+
+/* a pure primitive called on constants is called right away, unless it
+ * returns an error, which is left for when (and if) the call is run */
+static Object *_fold(const PrimitiveDef *prim, Object *args, size_t argc)
+{
+    if (!(prim->flags & PRIM_PURE) || argc > FOLD_MAX_ARGS) return NULL;
+
+    Object *argv[FOLD_MAX_ARGS];
+    for (size_t i = 0; i < argc; i++, args = args->list.cdr) {
+        Object *arg = args->list.car;
+        bool constant = !arg->eval || arg->kind == O_NUM || arg->kind == O_STR
+                     || arg->kind == O_CHAR || arg->kind == O_NIL;
+        if (!constant) return NULL;
+        argv[i] = arg;
+    }
+    return eval_try_primitive(prim, argv, argc);
+}
+
+/* if the special form can be compiled in place, otherwise it's called */
+static bool _special_form_fits(Compiler *c, enum SpecialForm sf, Object *args, size_t argc, Tail tail)
+{
+    switch (sf) {
+        case SF_IF: return argc == 3;
+        case SF_COND: return argc % 2 == 0;
+        case SF_DO: return true;
+        case SF_AND:
+        case SF_OR: return argc >= 1;
+        case SF_DEF: return argc == 2 && args->list.car->kind == O_IDENT;
+        /* anywhere else it's called, and reports an error */
+        case SF_RECUR: return (tail & TAIL_LOOP) && argc == c->loop->o->let->binding_count;
+        /* made into an O_LAMBDA or O_LET by the resolver */
+        case SF_LAMBDA:
+        case SF_LET:
+        case SF_LOOP:
+        case SF_EVAL:
+        case SF_LOAD:
+        case SF_IMPORT_SHARED:
+        case SF_NONE:
+            break;
+    }
+    return false;
+}
+
+static void _compile_special_form(Compiler *c, enum SpecialForm sf, Object *args, Tail tail)
+{
+    switch (sf) {
+        case SF_IF: _compile_if(c, args, tail); break;
+        case SF_COND: _compile_cond(c, args, tail); break;
+        case SF_DO: _compile_do(c, args, tail); break;
+        case SF_AND: _compile_and_or(c, args, OP_JUMP_IF_NIL_ELSE_POP, tail); break;
+        case SF_OR: _compile_and_or(c, args, OP_JUMP_UNLESS_NIL_ELSE_POP, tail); break;
+        case SF_DEF:
+            _compile(c, args->list.cdr->list.car, TAIL_NONE);
+            _emit(c, OP_DEF);
+            _emit(c, _constant(c, args->list.car));
+            break;
+        case SF_RECUR: _compile_recur(c, args); break;
+        default: assert(0);
+    }
+}
+
+static void _compile_list(Compiler *c, Object *o, Tail tail)
+{
+    Object *head = o->list.car;
+    Object *args = o->list.cdr;
+
+    size_t argc;
+    if (!_proper_list(args, &argc)) {
+        /* leave the error about pairs to the evaluator */
+        _emit(c, OP_EVAL);
+        _emit(c, _constant(c, o));
+        return;
+    }
+
+    if (head->kind == O_IDENT && head->eval) {
+        Object *value = env_lookup(c->env, head);
+
+        /* special forms and primitives can be redefined, so check it's
+         * still the same one at runtime and fall back to a normal call
+         * if it isn't */
+        enum SpecialForm sf = eval_special_form(value);
+        const PrimitiveDef *prim = value && value->kind == O_BUILTIN ? value->prim : NULL;
+        bool fits = _special_form_fits(c, sf, args, argc, tail);
+        bool inline_prim = prim && !(prim->flags & PRIM_NO_INLINE)
+                        && argc >= prim->min_args && argc <= prim->max_args;
+        if (fits || inline_prim) {
+            _emit(c, OP_GUARD);
+            _emit(c, _constant(c, head));
+            _emit(c, _cache(c));
+            _emit(c, _constant(c, value));
+            size_t to_fallback = _emit(c, 0);
+
+            Object *folded;
+            if (fits) {
+                _compile_special_form(c, sf, args, tail);
+            } else if ((folded = _fold(prim, args, argc))) {
+                _emit(c, OP_CONST);
+                _emit(c, _constant(c, folded));
+            } else {
+                for (; args->kind == O_LIST; args = args->list.cdr)
+                    _compile(c, args->list.car, TAIL_NONE);
+                _emit(c, OP_PRIM);
+                _emit(c, _constant(c, value));
+                _emit(c, (Instr)argc);
+            }
+            size_t to_end = _emit_jump(c, OP_JUMP);
+
+            _patch(c, to_fallback);
+            _compile_call(c, o, argc, tail);
+            _patch(c, to_end);
+            return;
+        }
+    }
+
+    _compile_call(c, o, argc, tail);
+}
+
+static void _compile(Compiler *c, Object *o, Tail tail)
+{
+    /* quoted data is never code */
+    if (!o->eval) {
+        _emit(c, OP_CONST);
+        _emit(c, _constant(c, o));
+        return;
+    }
+
+    switch (o->kind) {
+        case O_IDENT:
+            _emit(c, OP_GLOBAL);
+            _emit(c, _constant(c, o));
+            _emit(c, _cache(c));
+            break;
+        case O_LOCAL:
+            _emit(c, OP_LOCAL);
+            _emit(c, o->local.depth);
+            _emit(c, o->local.slot);
+            _emit(c, _constant(c, o->local.ident));
+            break;
+        case O_LAMBDA:
+            _emit(c, OP_CLOSURE);
+            _emit(c, _constant(c, o));
+            break;
+        case O_LET:
+            _compile_let(c, o, tail);
+            break;
+        case O_LIST:
+            _compile_list(c, o, tail);
+            break;
+        case O_NIL: case O_STR: case O_NUM: case O_ERROR: case O_BUILTIN: case O_FUNCTION: case O_CHAR: case O_VECTOR:
+        case O_MAP: case O_SET: case O_STRING_BUILDER:
+            _emit(c, OP_CONST);
+            _emit(c, _constant(c, o));
+            break;
+    }
+}
+
+void compile_lambda(Env *e, Object *lambda)
+{
+    assert(lambda->kind == O_LAMBDA);
+    assert(lambda->lambda->code == NULL);
+
+    Compiler c = {
+        .env = e,
+        .code = { 0, 16, malloc(sizeof(Instr) * 16) },
+        .constants = { 0, 4, malloc(sizeof(Object *) * 4) },
+        .caches = 0,
+        .loop = NULL,
+    };
+    CHECK_ALLOC(c.code.ptr);
+    CHECK_ALLOC(c.constants.ptr);
+
+    _compile(&c, lambda->lambda->resolved, TAIL_CALL);
+    _emit(&c, OP_RETURN);
+
+    struct InlineCache *caches = calloc(c.caches ? c.caches : 1, sizeof(struct InlineCache));
+    CHECK_ALLOC(caches);
+
+    struct Code *code = malloc(sizeof(struct Code));
+    CHECK_ALLOC(code);
+    *code = (struct Code) {
+        .instrs = c.code.ptr,
+        .len = c.code.len,
+        .constants = c.constants.ptr,
+        .constant_count = c.constants.len,
+        .caches = caches,
+        .cache_count = c.caches,
+    };
+    lambda->lambda->code = code;
+    GC_write_barrier(lambda);
+}
+
+void code_free(struct Code *code)
+{
+    free(code->instrs);
+    free(code->constants);
+    free(code->caches);
+    free(code);
+}
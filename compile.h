@@ -0,0 +1,69 @@
+#ifndef COMPILE_HEADER__
+#define COMPILE_HEADER__
+
+#include <stdint.h>
+#include "object.h"
+
+/* The compiler turns the resolved body of a lambda (see resolve.h) into
+ * bytecode for the vm (see vm.h). A lambda is compiled the first time it
+ * is run.
+ *
+ * Code is a flat array of 32 bit words, an opcode followed by its
+ * operands. Operands named k index the constants, jump targets are
+ * absolute indices into the code. */
+
+enum Opcode {
+    OP_CONST, /* k: push constants[k] */
+    OP_NIL, /* push nil */
+    OP_LOCAL, /* depth slot k: push a lexically addressed variable named constants[k] */
+    OP_GLOBAL, /* k c: push the value of identifier constants[k], cached in caches[c] */
+    OP_SET_LOCAL, /* slot: pop into slot of the current frame */
+    OP_POP,
+    OP_JUMP, /* target */
+    OP_JUMP_IF_NIL, /* target: pop, jump if it was nil */
+    OP_JUMP_IF_NIL_ELSE_POP, /* target: jump if nil keeping it, else pop (and) */
+    OP_JUMP_UNLESS_NIL_ELSE_POP, /* target: jump if not nil keeping it, else pop (or) */
+    OP_CLOSURE, /* k: push a function of the O_LAMBDA constants[k] */
+    OP_LET_ENTER, /* k: enter a frame for the O_LET constants[k] */
+    OP_LET_EXIT, /* leave the frame made by OP_LET_ENTER */
+    OP_RECUR, /* k lets: leave lets frames, then bind the slots of the loop
+               * (the O_LET constants[k]) to the values on top of the stack */
+    OP_DEF, /* k: bind constants[k] to the top of the stack, replace it with (name value) */
+    OP_PREPARE_CALL, /* k target: if the top is a Builtin call it with the
+                      * unevaluated arguments constants[k] and jump to target */
+    OP_CALL, /* argc k: call the function or primitive under the arguments,
+              * k is its name for errors */
+    OP_TAIL_CALL, /* argc k: like OP_CALL but the callee replaces the current frame */
+    OP_GUARD, /* k c p target: unless constants[k] (cached in caches[c]) is
+               * still bound to the builtin or primitive constants[p], jump */
+    OP_PRIM, /* p argc: call the primitive constants[p] on the top argc values */
+    OP_EVAL, /* k: evaluate constants[k] with eval_expr */
+    OP_RETURN,
+};
+
+typedef uint32_t Instr;
+
+/* every global lookup remembers the binding it found, it's good as long
+ * as the global environment is the same one and env_version hasn't
+ * changed since. Frames with defs are never looked past (see vm.c) */
+struct InlineCache {
+    uint64_t version; /* 0 if it's empty */
+    Env *globals;
+    EnvBinding *binding;
+};
+
+struct Code {
+    Instr *instrs;
+    size_t len;
+    Object **constants;
+    size_t constant_count;
+    struct InlineCache *caches;
+    size_t cache_count;
+};
+
+/* e is the environment the lambda is first run in, it's used to find out
+ * which special forms and primitives the identifiers refer to */
+void compile_lambda(Env *e, Object *lambda);
+void code_free(struct Code *code);
+
+#endif
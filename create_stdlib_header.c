@@ -21,8 +21,9 @@ int main(void)
         printf("%d, ", (char)c);
     }
 
+    /* the lexer expects a null-terminated string */
     printf(
-        "};\n"
+        "0};\n"
         "\n"
         "#endif\n");
 
@@ -1,6 +1,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "util.h"
 #include "environment.h"
 #include "object.h"
@@ -8,21 +9,85 @@
 /* env_new() is in object.h because it needs to interact with
  * static garbage collector state */
 
+#define ENV_TABLE_MIN_CAPACITY 64
+
+uint64_t env_version = 1;
+
 void env_free(Env *e)
 {
-    arena_destroy(e->arena);
+    if (e->arena) arena_destroy(e->arena);
+    free(e->table);
+    free(e);
 }
 
-static int _stringslice_cmp(struct StringSlice a, struct StringSlice b)
+/* the bucket ident is in, or the empty one it would go in */
+static inline EnvBinding **_table_find(EnvTable *t, Object *ident)
 {
-    return (a.len == b.len) ? memcmp(a.ptr, b.ptr, a.len) : a.len - b.len;
+    size_t mask = t->capacity - 1;
+    for (size_t i = object_ident_hash(ident) & mask;; i = (i + 1) & mask) {
+        EnvBinding *b = t->buckets[i];
+        if (b == NULL || IDENT_EQ(b->ident, ident)) return &t->buckets[i];
+    }
+}
+
+static EnvTable *_table_new(size_t capacity)
+{
+    EnvTable *ret = malloc(sizeof(EnvTable) + sizeof(EnvBinding *) * capacity);
+    CHECK_ALLOC(ret);
+    ret->count = 0;
+    ret->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++)
+        ret->buckets[i] = NULL;
+    return ret;
+}
+
+/* kept at most 3/4 full so probing stays short */
+static void _table_grow(Env *e)
+{
+    EnvTable *old = e->table;
+    EnvTable *t = _table_new(old ? old->capacity * 2 : ENV_TABLE_MIN_CAPACITY);
+    if (old) {
+        for (size_t i = 0; i < old->capacity; i++)
+            if (old->buckets[i]) *_table_find(t, old->buckets[i]->ident) = old->buckets[i];
+        t->count = old->count;
+        free(old);
+    }
+    e->table = t;
+}
+
+static void _table_put(Env *e, Object *ident, Object *value)
+{
+    if (e->table == NULL || (e->table->count + 1) * 4 > e->table->capacity * 3)
+        _table_grow(e);
+
+    EnvBinding **bucket = _table_find(e->table, ident);
+    if (*bucket == NULL) {
+        *bucket = arena_alloc(env_arena(e), sizeof(EnvBinding));
+        (*bucket)->ident = ident;
+        e->table->count++;
+        env_version++;
+    }
+    (*bucket)->value = value;
+}
+
+/* identifiers are interned so equal identifiers share a name pointer. The
+ * tree is ordered by the identifier's hash rather than its address so it
+ * stays balanced-ish when symbols are allocated in increasing order */
+static inline int _ident_cmp(Object *a, Object *b)
+{
+    if (IDENT_EQ(a, b)) return 0;
+    uint64_t ha = object_ident_hash(a), hb = object_ident_hash(b);
+    if (ha != hb) return ha < hb ? -1 : 1;
+    return (uintptr_t)a->str.ptr < (uintptr_t)b->str.ptr ? -1 : 1;
 }
 
 static EnvValueStore *_evstore_insert(EnvValueStore *cur, Object *ident, Object *val, Arena *a)
 {
     if (cur == NULL) {
+        /* no env_version++, the inline caches never look past a frame
+         * with a store (see _global_binding in vm.c) */
         EnvValueStore *to_insert = arena_alloc(a, sizeof(EnvValueStore));
-        
+
         *to_insert = (struct EnvValueStore) {
             .ident = ident,
             .value = val
@@ -31,7 +96,7 @@ static EnvValueStore *_evstore_insert(EnvValueStore *cur, Object *ident, Object
         return to_insert;
     }
 
-    int cmp = _stringslice_cmp(ident->str, cur->ident->str);
+    int cmp = _ident_cmp(ident, cur->ident);
     if (cmp == 0) /* equal */ {
         cur->ident = ident;
         cur->value = val;
@@ -45,24 +110,64 @@ static EnvValueStore *_evstore_insert(EnvValueStore *cur, Object *ident, Object
     return cur;
 }
 
+/* slots are searched from the back so a repeated parameter name
+ * (\ (x x) ...) refers to the last one */
+static inline Object **_env_find_slot(Env *e, Object *ident)
+{
+    for (size_t i = e->slot_count; i-- > 0;) {
+        if (IDENT_EQ(e->slot_names[i], ident)) return &e->slots[i];
+    }
+    return NULL;
+}
+
 void env_put(Env *e, Object *ident, Object *value)
 {
     assert(ident->kind == O_IDENT);
-    e->store = _evstore_insert(e->store, ident, value, e->arena); 
+    GC_env_write_barrier(e);
+    Object **slot = _env_find_slot(e, ident);
+    if (slot) { *slot = value; return; }
+    /* frames only get the odd def, everything else is global */
+    if (e->scope == NULL) { _table_put(e, ident, value); return; }
+    e->store = _evstore_insert(e->store, ident, value, env_arena(e));
 }
 
-Object *env_get(Env *e, Object *ident)
+Object *env_lookup(Env *e, Object *ident)
 {
     assert(ident->kind == O_IDENT);
-    EnvValueStore *cursor = e->store;
-    while (cursor != NULL) {
-        int cmp = _stringslice_cmp(ident->str, cursor->ident->str);
-        if (cmp == 0) return cursor->value;
-        else if (cmp < 0) cursor = cursor->left;
-        else cursor = cursor->right;
+    for (; e != NULL; e = e->parent) {
+        Object **slot = _env_find_slot(e, ident);
+        if (slot && *slot) return *slot;
+
+        if (e->table) {
+            EnvBinding *b = *_table_find(e->table, ident);
+            if (b) return b->value;
+            continue;
+        }
+
+        EnvValueStore *cursor = e->store;
+        while (cursor != NULL) {
+            int cmp = _ident_cmp(ident, cursor->ident);
+            if (cmp == 0) return cursor->value;
+            else if (cmp < 0) cursor = cursor->left;
+            else cursor = cursor->right;
+        }
     }
 
-    if (e->parent != NULL) return env_get(e->parent, ident);
-    else return object_error_new("identifier \"%s\" not found", ident);
+    return NULL;
+}
+
+EnvBinding *env_global_binding(Env *e, Object *ident)
+{
+    for (; e && e->scope; e = e->parent)
+        if (e->store || _env_find_slot(e, ident)) return NULL;
+    if (e == NULL || e->table == NULL) return NULL;
+    return *_table_find(e->table, ident);
+}
+
+Object *env_get(Env *e, Object *ident)
+{
+    Object *value = env_lookup(e, ident);
+    if (value == NULL) return object_error_new("identifier \"%s\" not found", ident);
+    return value;
 }
 
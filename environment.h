@@ -7,8 +7,56 @@
  * definitions */
 
 Env *env_new(Env *parent /* nullable */);
+/* Frames for calls and lets live on the frame stack instead of the heap,
+ * the gc doesn't keep track of them until they're popped. A frame that
+ * escaped by then (a lambda that closes over it was made, see
+ * object_function_new) is handed over to the gc, the rest are reused.
+ * Frames are popped in the reverse order they're pushed: by whoever pushed
+ * them, or by vm_restore when an error unwinds the stack. */
+
+/* a frame with the slots described by scope (an O_LAMBDA or O_LET) */
+Env *env_push_frame(Env *parent, Object *scope);
+size_t env_frame_count(void);
+/* pops frames until there are count left */
+void env_pop_frames(size_t count);
+/* e and the frames under it are pointed to from the heap */
+void env_escape(Env *e);
+/* the frame a flat lambda made in e closes over (see resolve.h), with the
+ * values of what it captures. Its parent is the global environment e is
+ * in, a lambda that doesn't capture anything gets that directly */
+Env *env_new_closure(Env *e, Object *lambda);
 void env_free(Env *e);
+/* the arena e's store is allocated from, made (or taken from the pool of
+ * recycled ones) the first time something is def'd into e */
+Arena *env_arena(Env *e);
 void env_put(Env *e, Object *ident, Object *value);
 Object *env_get(Env *e, Object *ident);
+/* like env_get but returns NULL instead of an error */
+Object *env_lookup(Env *e, Object *ident);
+
+/* bumped whenever a new global binding is made (def, load, import-shared)
+ * or a global environment goes away, see struct InlineCache. A def into a
+ * frame doesn't bump it */
+extern uint64_t env_version;
+/* the binding ident has in the global environment e is in. NULL if a
+ * frame of e has (or might get) a binding for it instead, or there's none */
+EnvBinding *env_global_binding(Env *e, Object *ident);
+
+/* the value of a lexically addressed variable (see resolve.h) */
+static inline Object *env_get_local(Env *e, uint32_t depth, uint32_t slot, Object *ident)
+{
+    Env *frame = e;
+    for (uint32_t i = 0; i < depth; i++) {
+        /* something was def'd into a frame in between, which might
+         * shadow the binding, so look it up by name instead */
+        if (frame->store) return env_get(e, ident);
+        frame = frame->parent;
+    }
+
+    Object *value = frame->slots[slot];
+    /* not bound yet, like a let binding refering to a later one */
+    if (value == NULL) return env_get(e, ident);
+    return value;
+}
 
 #endif
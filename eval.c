@@ -4,6 +4,7 @@
 #include <setjmp.h>
 #include <stdio.h>
 #include "eval.h"
+#include "heap.h"
 #include <time.h>
 #include <gmp.h>
 #include <time.h>
@@ -11,97 +12,196 @@
 #include "util.h"
 #include "lexer.h"
 #include "parser.h"
+#include "resolve.h"
+#include "vm.h"
+#include "number.h"
+#include "map.h"
 
 jmp_buf on_error_jmp_buf;
 Object *on_error_error = NULL;
 
 gmp_randstate_t randstate;
 
+/* interned identifiers the evaluator compares against */
+static Object *ampersand_ident = NULL;
+
 static Object *_eval_sexpr(Env *e, Object *o);
+static Object *_eval_local(Env *e, Object *o);
+static Object *_eval_let(Env *e, Object *o);
 
-static Object *_builtin_add(Env *e, Object *o);
-static Object *_builtin_subtract(Env *e, Object *o);
-static Object *_builtin_multiply(Env *e, Object *o);
-static Object *_builtin_divide(Env *e, Object *o);
-static Object *_builtin_exit(Env *e, Object *o);
-static Object *_builtin_cons(Env *e, Object *o);
 static Object *_builtin_eval(Env *e, Object *o);
-static Object *_builtin_first(Env *e, Object *o);
-static Object *_builtin_rest(Env *e, Object *o);
 static Object *_builtin_def(Env *e, Object *o);
-static Object *_builtin_print_gc_status(Env *e, Object *o);
-static Object *_builtin_error(Env *e, Object *o);
 static Object *_builtin_lambda(Env *e, Object *o);
 static Object *_builtin_if(Env *e, Object *o);
-static Object *_builtin_equals(Env *e, Object *o);
-static Object *_builtin_print(Env *e, Object *o);
-static Object *_builtin_println(Env *e, Object *o);
-static Object *_builtin_mod(Env *e, Object *o);
-static Object *_builtin_not(Env *e, Object *o);
 static Object *_builtin_and(Env *e, Object *o);
 static Object *_builtin_or(Env *e, Object *o);
-static Object *_builtin_lt(Env *e, Object *o);
-static Object *_builtin_gt(Env *e, Object *o);
 static Object *_builtin_load(Env *e, Object *o);
 static Object *_builtin_let(Env *e, Object *o);
+static Object *_builtin_loop(Env *e, Object *o);
+static Object *_builtin_recur(Env *e, Object *o);
 static Object *_builtin_do(Env *e, Object *o);
 static Object *_builtin_cond(Env *e, Object *o);
-static Object *_builtin_input(Env *e, Object *o);
-static Object *_builtin_num(Env *e, Object *o);
-static Object *_builtin_rand(Env *e, Object *o);
-static Object *_builtin_ident(Env *e, Object *o);
-static Object *_builtin_char_list(Env *e, Object *o);
-static Object *_builtin_string(Env *e, Object *o);
-static Object *_builtin_typeof(Env *e, Object *o);
 static Object *_builtin_import_shared(Env *e, Object *o);
-static Object *_builtin_read(Env *e, Object *o);
 
+static Object *_prim_add(Object **argv, size_t argc);
+static Object *_prim_subtract(Object **argv, size_t argc);
+static Object *_prim_multiply(Object **argv, size_t argc);
+static Object *_prim_divide(Object **argv, size_t argc);
+static Object *_prim_mod(Object **argv, size_t argc);
+static Object *_prim_lt(Object **argv, size_t argc);
+static Object *_prim_gt(Object **argv, size_t argc);
+static Object *_prim_equals(Object **argv, size_t argc);
+static Object *_prim_cons(Object **argv, size_t argc);
+static Object *_prim_not(Object **argv, size_t argc);
+static Object *_prim_first(Object **argv, size_t argc);
+static Object *_prim_rest(Object **argv, size_t argc);
+static Object *_prim_exit(Object **argv, size_t argc);
+static Object *_prim_print_gc_status(Object **argv, size_t argc);
+static Object *_prim_error(Object **argv, size_t argc);
+static Object *_prim_print(Object **argv, size_t argc);
+static Object *_prim_println(Object **argv, size_t argc);
+static Object *_prim_input(Object **argv, size_t argc);
+static Object *_prim_num(Object **argv, size_t argc);
+static Object *_prim_rand(Object **argv, size_t argc);
+static Object *_prim_ident(Object **argv, size_t argc);
+static Object *_prim_char_list(Object **argv, size_t argc);
+static Object *_prim_string(Object **argv, size_t argc);
+static Object *_prim_typeof(Object **argv, size_t argc);
+static Object *_prim_read(Object **argv, size_t argc);
+static Object *_prim_map(Object **argv, size_t argc);
+static Object *_prim_filter(Object **argv, size_t argc);
+static Object *_prim_all(Object **argv, size_t argc);
+static Object *_prim_foldl(Object **argv, size_t argc);
+static Object *_prim_foldr(Object **argv, size_t argc);
+static Object *_prim_len(Object **argv, size_t argc);
+static Object *_prim_reverse(Object **argv, size_t argc);
+static Object *_prim_take(Object **argv, size_t argc);
+static Object *_prim_drop(Object **argv, size_t argc);
+static Object *_prim_nth(Object **argv, size_t argc);
+static Object *_prim_range(Object **argv, size_t argc);
+static Object *_prim_dotimes(Object **argv, size_t argc);
+static Object *_prim_elem(Object **argv, size_t argc);
+static Object *_prim_concat(Object **argv, size_t argc);
+static Object *_prim_vector(Object **argv, size_t argc);
+static Object *_prim_vector_ref(Object **argv, size_t argc);
+static Object *_prim_vector_set(Object **argv, size_t argc);
+static Object *_prim_vector_push(Object **argv, size_t argc);
+static Object *_prim_vector_length(Object **argv, size_t argc);
+static Object *_prim_list_to_vector(Object **argv, size_t argc);
+static Object *_prim_vector_to_list(Object **argv, size_t argc);
+static Object *_prim_hash_map(Object **argv, size_t argc);
+static Object *_prim_hash_set(Object **argv, size_t argc);
+static Object *_prim_assoc(Object **argv, size_t argc);
+static Object *_prim_dissoc(Object **argv, size_t argc);
+static Object *_prim_set_add(Object **argv, size_t argc);
+static Object *_prim_set_remove(Object **argv, size_t argc);
+static Object *_prim_get(Object **argv, size_t argc);
+static Object *_prim_contains(Object **argv, size_t argc);
+static Object *_prim_keys(Object **argv, size_t argc);
+static Object *_prim_vals(Object **argv, size_t argc);
+static Object *_prim_count(Object **argv, size_t argc);
+static Object *_prim_string_append(Object **argv, size_t argc);
+static Object *_prim_string_join(Object **argv, size_t argc);
+static Object *_prim_string_builder(Object **argv, size_t argc);
+static Object *_prim_string_builder_append(Object **argv, size_t argc);
+
+/* special forms, and the builtins that need the environment */
 typedef struct { const char *name; Builtin func; } builtin_record;
 builtin_record builtins[] = {
-    { "+", _builtin_add },
-    { "-", _builtin_subtract },
-    { "*", _builtin_multiply },
-    { "/", _builtin_divide },
-    { "exit", _builtin_exit },
-    { "cons", _builtin_cons },
     { "eval", _builtin_eval },
-    { "first", _builtin_first },
-    { "rest", _builtin_rest },
     { "def", _builtin_def }, 
-    { "gc-status", _builtin_print_gc_status }, 
-    { "error", _builtin_error },
     { "\\", _builtin_lambda },
     { "if", _builtin_if },
-    { "=", _builtin_equals },
-    { "print", _builtin_print },
-    { "println", _builtin_println },
-    { "mod", _builtin_mod },
-    { "not", _builtin_not },
     { "and", _builtin_and },
     { "or", _builtin_or },
-    { "<", _builtin_lt },
-    { ">", _builtin_gt },
     { "load", _builtin_load },
     { "let", _builtin_let },
+    { "loop", _builtin_loop },
+    { "recur", _builtin_recur },
     { "do", _builtin_do },
     { "cond", _builtin_cond },
-    { "input", _builtin_input },
-    { "num", _builtin_num },
-    { "rand", _builtin_rand },
-    { "ident", _builtin_ident },
-    { "char-list", _builtin_char_list },
-    { "string", _builtin_string },
-    { "type-of", _builtin_typeof },
     { "import-shared", _builtin_import_shared },
-    { "read", _builtin_read },
+};
+
+static const PrimitiveDef primitives[] = {
+    { "+", _prim_add, 1, SIZE_MAX, PRIM_PURE },
+    { "-", _prim_subtract, 1, SIZE_MAX, PRIM_PURE },
+    { "*", _prim_multiply, 1, SIZE_MAX, PRIM_PURE },
+    { "/", _prim_divide, 1, SIZE_MAX, PRIM_PURE },
+    { "exit", _prim_exit, 0, 1, 0 },
+    { "cons", _prim_cons, 2, 2, PRIM_PURE },
+    { "first", _prim_first, 1, 1, PRIM_PURE },
+    { "rest", _prim_rest, 1, 1, PRIM_PURE },
+    { "gc-status", _prim_print_gc_status, 0, 0, 0 },
+    { "error", _prim_error, 1, 1, 0 },
+    { "=", _prim_equals, 2, 2, PRIM_PURE },
+    { "print", _prim_print, 1, SIZE_MAX, 0 },
+    { "println", _prim_println, 0, SIZE_MAX, 0 },
+    { "mod", _prim_mod, 2, 2, PRIM_PURE },
+    { "not", _prim_not, 1, 1, PRIM_PURE },
+    { "<", _prim_lt, 2, 2, PRIM_PURE },
+    { ">", _prim_gt, 2, 2, PRIM_PURE },
+    { "input", _prim_input, 0, 0, 0 },
+    { "num", _prim_num, 1, 1, PRIM_PURE },
+    { "rand", _prim_rand, 2, 2, 0 },
+    { "ident", _prim_ident, 1, 1, PRIM_PURE },
+    { "char-list", _prim_char_list, 1, 1, PRIM_PURE },
+    { "string", _prim_string, 1, 1, PRIM_PURE },
+    { "type-of", _prim_typeof, 1, 1, PRIM_PURE },
+    { "read", _prim_read, 1, 1, PRIM_PURE },
+    /* the list library, these used to be in stdlib.deeprose */
+    { "map", _prim_map, 2, 2, 0 },
+    { "filter", _prim_filter, 2, 2, 0 },
+    { "all?", _prim_all, 2, 2, 0 },
+    { "foldl", _prim_foldl, 3, 3, 0 },
+    { "foldr", _prim_foldr, 3, 3, 0 },
+    { "len", _prim_len, 1, 1, PRIM_PURE },
+    { "reverse", _prim_reverse, 1, 1, PRIM_PURE },
+    { "take", _prim_take, 2, 2, PRIM_PURE },
+    { "drop", _prim_drop, 2, 2, PRIM_PURE },
+    { "nth", _prim_nth, 2, 2, PRIM_PURE },
+    /* not folded, the list could be any size */
+    { "range", _prim_range, 2, 2, 0 },
+    { "dotimes", _prim_dotimes, 2, 2, 0 },
+    { "elem?", _prim_elem, 2, 2, PRIM_PURE },
+    { "concat", _prim_concat, 0, SIZE_MAX, PRIM_PURE },
+    { "apply", vm_prim_apply, 2, 2, PRIM_NO_INLINE },
+    /* vectors are changed in place, so none of these are folded */
+    { "vector", _prim_vector, 0, SIZE_MAX, 0 },
+    { "vector-ref", _prim_vector_ref, 2, 2, 0 },
+    { "vector-set!", _prim_vector_set, 3, 3, 0 },
+    { "vector-push!", _prim_vector_push, 2, 2, 0 },
+    { "vector-length", _prim_vector_length, 1, 1, 0 },
+    { "list->vector", _prim_list_to_vector, 1, 1, 0 },
+    { "vector->list", _prim_vector_to_list, 1, 1, 0 },
+    /* maps and sets never change, updating one makes a new one */
+    { "hash-map", _prim_hash_map, 0, SIZE_MAX, PRIM_PURE },
+    { "hash-set", _prim_hash_set, 0, SIZE_MAX, PRIM_PURE },
+    { "assoc", _prim_assoc, 3, 3, PRIM_PURE },
+    { "dissoc", _prim_dissoc, 2, 2, PRIM_PURE },
+    { "set-add", _prim_set_add, 2, 2, PRIM_PURE },
+    { "set-remove", _prim_set_remove, 2, 2, PRIM_PURE },
+    { "get", _prim_get, 2, 3, PRIM_PURE },
+    { "contains?", _prim_contains, 2, 2, PRIM_PURE },
+    { "keys", _prim_keys, 1, 1, PRIM_PURE },
+    { "vals", _prim_vals, 1, 1, PRIM_PURE },
+    { "count", _prim_count, 1, 1, PRIM_PURE },
+    { "string-append", _prim_string_append, 0, SIZE_MAX, PRIM_PURE },
+    { "string-join", _prim_string_join, 2, 2, PRIM_PURE },
+    /* builders are changed in place, (string b) gives what's in one */
+    { "string-builder", _prim_string_builder, 0, SIZE_MAX, 0 },
+    { "string-builder-append!", _prim_string_builder_append, 1, SIZE_MAX, 0 },
 };
 
 void env_add_default_variables(Env *e) 
 {
+    ampersand_ident = object_ident_new_cstr("&");
     for (size_t i = 0; i < sizeof(builtins) / sizeof(builtin_record); i++) {
         env_put(e, object_ident_new_cstr(builtins[i].name),
                     object_builtin_new(builtins[i].func));
     }
+    for (size_t i = 0; i < sizeof(primitives) / sizeof(PrimitiveDef); i++)
+        env_put(e, object_ident_new_cstr(primitives[i].name), object_primitive_new(&primitives[i]));
     env_put(e, object_ident_new_cstr("nil"), object_nil_new());
     env_put(e, object_ident_new_cstr("newline"), object_char_new('\n'));
     env_put(e, object_ident_new_cstr("space"), object_char_new(' '));
@@ -141,13 +241,13 @@ int eval_program(const char *program, Env *env /*nullable*/, bool print_eval)
 
         if (parser_at_eof(parser)) break;
         o = parser_parse(parser);
-        GC_collect_garbage(env, o);
+        GC_maybe_collect(env, o);
     }
     
     if (free_env) {
         GC_collect_garbage(NULL);
     } else {
-        GC_collect_garbage(env);
+        GC_maybe_collect(env);
     }
 
     arena_destroy(parser_arena);
@@ -158,7 +258,8 @@ Object *eval_expr(Env *e, Object *o)
 {
     if (!o->eval) return o;
     switch (o->kind) {
-        case O_STR: case O_NUM: case O_NIL: case O_ERROR: case O_BUILTIN: case O_FUNCTION: case O_CHAR:
+        case O_STR: case O_NUM: case O_NIL: case O_ERROR: case O_BUILTIN: case O_FUNCTION: case O_CHAR: case O_VECTOR:
+        case O_MAP: case O_SET: case O_STRING_BUILDER:
             return o;
 
         case O_IDENT:
@@ -166,6 +267,15 @@ Object *eval_expr(Env *e, Object *o)
 
         case O_LIST:
             return _eval_sexpr(e, o);
+
+        case O_LOCAL:
+            return _eval_local(e, o);
+
+        case O_LAMBDA:
+            return object_function_new(e, o);
+
+        case O_LET:
+            return _eval_let(e, o);
     }
 
     assert(0 && "infallible");
@@ -173,126 +283,145 @@ Object *eval_expr(Env *e, Object *o)
 
 Object *eval(Env *e, Object *o)
 {
+    /* eval is reentered by load, so put the caller's handler back after */
+    jmp_buf prev;
+    memcpy(prev, on_error_jmp_buf, sizeof(jmp_buf));
+    VMState vm_state = vm_save();
+    size_t root_count = GC_root_count();
+
+    Object *ret;
     if (setjmp(on_error_jmp_buf) != 0) {
-        return on_error_error;
+        vm_restore(vm_state);
+        GC_restore_roots(root_count);
+        ret = on_error_error;
+    } else {
+        ret = vm_execute(e, resolve_expr(e, o));
     }
 
-    return eval_expr(e, o);
-
+    memcpy(on_error_jmp_buf, prev, sizeof(jmp_buf));
+    return ret;
 }
 
-_Noreturn void report_error(Object *o)
+enum SpecialForm eval_special_form(Object *value)
 {
-    assert(o->kind == O_ERROR);
-    on_error_error = o;
-    longjmp(on_error_jmp_buf, 1);
+    if (value == NULL || value->kind != O_BUILTIN) return SF_NONE;
+    if (value->builtin == _builtin_if) return SF_IF;
+    if (value->builtin == _builtin_cond) return SF_COND;
+    if (value->builtin == _builtin_do) return SF_DO;
+    if (value->builtin == _builtin_and) return SF_AND;
+    if (value->builtin == _builtin_or) return SF_OR;
+    if (value->builtin == _builtin_def) return SF_DEF;
+    if (value->builtin == _builtin_lambda) return SF_LAMBDA;
+    if (value->builtin == _builtin_let) return SF_LET;
+    if (value->builtin == _builtin_loop) return SF_LOOP;
+    if (value->builtin == _builtin_recur) return SF_RECUR;
+    if (value->builtin == _builtin_eval) return SF_EVAL;
+    if (value->builtin == _builtin_load) return SF_LOAD;
+    if (value->builtin == _builtin_import_shared) return SF_IMPORT_SHARED;
+    return SF_NONE;
 }
 
-static Object *_builtin_add(Env *e, Object *o)
+Object *eval_try_primitive(const PrimitiveDef *prim, Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "+ requires arguments");
-    Object *num = object_num_new(0);
-
-    while (o->kind == O_LIST) {
-        Object *to_add = eval_expr(e, o->list.car);
-        EASSERT_TYPE("+", to_add, O_NUM);
-        mpz_add(num->num, num->num, to_add->num);
+    jmp_buf prev;
+    memcpy(prev, on_error_jmp_buf, sizeof(jmp_buf));
+    size_t root_count = GC_root_count();
 
-        o = o->list.cdr;
+    Object *ret;
+    if (setjmp(on_error_jmp_buf) != 0) {
+        GC_restore_roots(root_count);
+        ret = NULL;
+    } else {
+        ret = prim->fn(argv, argc);
     }
-    return num;
+
+    memcpy(on_error_jmp_buf, prev, sizeof(jmp_buf));
+    return ret;
 }
 
-static Object *_builtin_subtract(Env *e, Object *o)
+_Noreturn void report_error(Object *o)
 {
-    EASSERT(o->kind == O_LIST, "- requires arguments");
-    Object *lhs_object = eval_expr(e, o->list.car);
-    EASSERT_TYPE("-", lhs_object, O_NUM);
-    Object *lhs = object_shallow_copy(lhs_object);
-    o = o->list.cdr;
-    if (o->kind != O_LIST) /* unary minus */
-        mpz_neg(lhs->num, lhs->num);
-
-    while (o->kind == O_LIST) {
-        Object *rhs = eval_expr(e, o->list.car);
-        EASSERT_TYPE("-", rhs, O_NUM);
-        mpz_sub(lhs->num, lhs->num, rhs->num);
+    assert(o->kind == O_ERROR);
+    on_error_error = o;
+    longjmp(on_error_jmp_buf, 1);
+}
 
-        o = o->list.cdr;
-    }
+/* the primitives take their arguments already evaluated, so unlike the
+ * builtins the type errors only come after every argument has been evaluated.
+ * All the checks are done before calculating anything, so the result can
+ * be built up in a struct Num without leaking it on an error */
 
-    return lhs;
+static Object *_prim_add(Object **argv, size_t argc)
+{
+    for (size_t i = 0; i < argc; i++)
+        EASSERT_TYPE("+", argv[i], O_NUM);
+
+    struct Num sum;
+    num_init_si(&sum, 0);
+    for (size_t i = 0; i < argc; i++)
+        num_add(&sum, &sum, &argv[i]->num);
+    return object_num_new_num(&sum);
 }
 
-static Object *_builtin_multiply(Env *e, Object *o) 
+static Object *_prim_subtract(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "* requires arguments");
-    Object *num = object_num_new(1);
-
+    for (size_t i = 0; i < argc; i++)
+        EASSERT_TYPE("-", argv[i], O_NUM);
 
-    while (o->kind == O_LIST) {
-        Object *to_mult = eval_expr(e, o->list.car);
-        EASSERT_TYPE("*", to_mult, O_NUM);
-        mpz_mul(num->num, num->num, to_mult->num);
-        o = o->list.cdr;
-    }
+    struct Num lhs;
+    num_init_copy(&lhs, &argv[0]->num);
+    if (argc == 1) /* unary minus */
+        num_neg(&lhs, &lhs);
 
-    return num;
+    for (size_t i = 1; i < argc; i++)
+        num_sub(&lhs, &lhs, &argv[i]->num);
+    return object_num_new_num(&lhs);
 }
 
-static Object *_builtin_divide(Env *e, Object *o) 
+static Object *_prim_multiply(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "/ requires arguments");
-    Object *lhs_object = eval_expr(e, o->list.car);
-    EASSERT_TYPE("/", lhs_object, O_NUM);
-
-    Object *lhs = object_shallow_copy(lhs_object);
-    o = o->list.cdr;
-
-    while (o->kind == O_LIST) {
-        Object *rhs = eval_expr(e, o->list.car);
-        EASSERT_TYPE("/", rhs, O_NUM);
-        EASSERT(mpz_cmp_si(rhs->num, 0), "/: divide by zero");
+    for (size_t i = 0; i < argc; i++)
+        EASSERT_TYPE("*", argv[i], O_NUM);
+
+    struct Num product;
+    num_init_si(&product, 1);
+    for (size_t i = 0; i < argc; i++)
+        num_mul(&product, &product, &argv[i]->num);
+    return object_num_new_num(&product);
+}
 
-        mpz_cdiv_q(lhs->num, lhs->num, rhs->num);
-        o = o->list.cdr;
+static Object *_prim_divide(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("/", argv[0], O_NUM);
+    for (size_t i = 1; i < argc; i++) {
+        EASSERT_TYPE("/", argv[i], O_NUM);
+        EASSERT(num_sgn(&argv[i]->num), "/: divide by zero");
     }
 
-    return lhs;
+    struct Num lhs;
+    num_init_copy(&lhs, &argv[0]->num);
+    for (size_t i = 1; i < argc; i++)
+        num_cdiv_q(&lhs, &lhs, &argv[i]->num);
+    return object_num_new_num(&lhs);
 }
 
-static Object *_builtin_exit(Env *e, Object *o)
+static Object *_prim_exit(Object **argv, size_t argc)
 {
-    if (o->kind == O_NIL) {
-        GC_collect_garbage(NULL);
-        exit(0);
-    } else {
-        EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to exit");
-        Object *exit_code_object = eval_expr(e, o->list.car);
-
-        EASSERT_TYPE("exit", exit_code_object, O_NUM);
-        int exit_code = (int)mpz_get_si(exit_code_object->num);
-        GC_collect_garbage(NULL);
-        exit(exit_code);
+    int exit_code = 0;
+    if (argc == 1) {
+        EASSERT_TYPE("exit", argv[0], O_NUM);
+        exit_code = (int)num_get_si(&argv[0]->num);
     }
+    GC_collect_garbage(NULL);
+    exit(exit_code);
 }
 
-static Object *_builtin_cons(Env *e, Object *o)
+static Object *_prim_cons(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "cons needs two arguments");
-    Object *car = eval_expr(e, o->list.car);
-    EASSERT(o->list.cdr->kind == O_LIST, "cons needs two arguments");
-    Object *cdr = eval_expr(e, o->list.cdr->list.car);
-    /* Cons used to be able to take any argument for the cdr, leading to a pair like in
-     * scheme IE (a . b) 
-     * I have decided that the second argument of cons must be a list, mostly because
-     * no functions support the pair functionality, and I believe some of the builtins
-     * might have UB asociated with it. Its a neat feature, but fundamentally not usefull 
-     * + will most likely lead to footguns and bugs. */
+    Object *cdr = argv[1];
     EASSERT(cdr->kind == O_LIST || cdr->kind == O_NIL, "cons: expected List or Nil, got %sc", object_type_as_string(cdr->kind));
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to cons");
-    
-    Object *ret = object_list_new(car, cdr);
+
+    Object *ret = object_list_new(argv[0], cdr);
     ret->eval = false;
     return ret;
 }
@@ -303,29 +432,24 @@ static Object *_builtin_eval(Env *e, Object *o)
     EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to eval");
     Object *quoted_item = eval_expr(e, o->list.car);
     EASSERT(!quoted_item->eval, "eval: already evaluated");
-    Object *to_eval = object_shallow_copy(quoted_item);
-    to_eval->eval = true;
+    /* shared objects are swapped for their evaluated twin, anything else
+     * is copied so the quoted one isn't changed */
+    Object *to_eval = object_with_eval(quoted_item->permanent ? quoted_item
+                                       : object_shallow_copy(quoted_item), true);
+    if (to_eval->kind == O_LIST) return vm_execute(e, resolve_expr(e, to_eval));
     return eval_expr(e, to_eval);
 }
 
-static Object *_builtin_first(Env *e, Object *o)
+static Object *_prim_first(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "first requires an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to first");
-    Object *arg1 = eval_expr(e, o->list.car);
-    EASSERT_TYPE("first", arg1, O_LIST);
-
-    return arg1->list.car;
+    EASSERT_TYPE("first", argv[0], O_LIST);
+    return argv[0]->list.car;
 }
 
-static Object *_builtin_rest(Env *e, Object *o)
+static Object *_prim_rest(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "rest requires an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to rest");
-    Object *arg1 = eval_expr(e, o->list.car);
-    EASSERT_TYPE("rest", arg1, O_LIST);
-
-    return arg1->list.cdr;
+    EASSERT_TYPE("rest", argv[0], O_LIST);
+    return argv[0]->list.cdr;
 }
 
 static Object *_builtin_def(Env *e, Object *o)
@@ -342,24 +466,30 @@ static Object *_builtin_def(Env *e, Object *o)
 
 static Object *_eval_list_elements(Env *e, Object *o)
 {
-    if (o->kind != O_LIST) return object_new_generic();
+    if (o->kind != O_LIST) return object_nil_new();
     Object *ret = object_new_generic();
     ret->kind = O_LIST;
     ret->eval = false;
+    /* the list is filled in as it goes, so its car and cdr have to be
+     * something the gc can mark */
+    ret->list.car = ret->list.cdr = object_nil_new();
+    GC_push_root(&ret);
 
     Object *cursor = ret;
     while (o->kind != O_NIL) {
         cursor->list.car = eval_expr(e, o->list.car);
+        /* the gc may have run and promoted the list */
+        GC_write_barrier(cursor);
         o = o->list.cdr;
         if (o->kind != O_LIST) {
             cursor->list.cdr = object_nil_new();
         } else {
-            cursor->list.cdr = object_new_generic();
+            cursor->list.cdr = object_list_new(object_nil_new(), object_nil_new());
             cursor = cursor->list.cdr;
-            cursor->kind = O_LIST;
         }
     }
 
+    GC_pop_roots(1);
     return ret;
 }
 
@@ -378,75 +508,65 @@ static Object *_eval_sexpr(Env *e, Object *o)
         /* force evaluation of identifiers in function calls like clojure or scheme
          * so this code should work:
          * (eval (cons '+ '(1 2 3))) => 6 */
-        Object *to_eval = object_shallow_copy(o->list.car);
-        to_eval->eval = true;
-        f = eval_expr(e, to_eval);
+        f = env_get(e, o->list.car);
     } else {
         f = eval_expr(e, o->list.car);
     }
 
-    if (f->kind == O_BUILTIN) return f->builtin(e, o->list.cdr);
+    if (f->kind == O_BUILTIN && f->builtin) return f->builtin(e, o->list.cdr);
+    if (f->kind == O_BUILTIN) return vm_apply_primitive(e, f, o->list.cdr);
     else {
         if (f->kind != O_FUNCTION) {
             return object_error_new("invalid function call, expected function got %sc", object_type_as_string(f->kind));
         }
-        Env *env = env_new(f->function.env);
-        
-        Object *funcname = o->list.car->kind == O_IDENT ? o->list.car : object_string_slice_new_cstr("<anonymous>");
-        //Object *funcname = object_string_slice_new_cstr("<anonymous>");
-
-        bool variadic = false;
-        {
-            Object *cursor = f->function.arguments;
-            Object *args_cursor = o->list.cdr;
-            while (cursor->kind != O_NIL) {
-                char ampersand[] = "&";
-                if (cursor->list.car->str.len == strlen(ampersand) 
-                        && memcmp(cursor->list.car->str.ptr, ampersand, cursor->list.car->str.len) == 0) {
-
-                    EASSERT(cursor->list.cdr->kind != O_NIL 
-                            && cursor->list.cdr->list.car->kind == O_IDENT, 
-                            "function needs identifier past ampersand for variadics");
-
-                    /* give it an empty list if there are no variadic args */
-                    if (args_cursor->kind == O_NIL) env_put(env, cursor->list.cdr->list.car, object_nil_new());
-                    else env_put(env, cursor->list.cdr->list.car, _eval_list_elements(e, args_cursor));
-
-                    variadic = true;
-                    break;
-                }
-                if (args_cursor->kind == O_NIL) {
-                    return object_error_new("function %s passed too few values", funcname);
-                }
-                EASSERT(args_cursor->kind == O_LIST, "invalid function call form");
-                env_put(env, cursor->list.car, eval_expr(e, args_cursor->list.car));
-                
-                cursor = cursor->list.cdr;
-                args_cursor = args_cursor->list.cdr;
-            }
-            if (!variadic && args_cursor->kind != O_NIL) {
-                return object_error_new("function %s passed too many values", funcname);
+        struct Lambda *lambda = f->function.lambda->lambda;
+        size_t frames = env_frame_count();
+        Env *env = env_push_frame(f->function.env, f->function.lambda);
+        GC_push_root(&f);
+
+        Object *head = o->list.car;
+        Object *funcname = head->kind == O_IDENT ? head
+                         : head->kind == O_LOCAL ? head->local.ident
+                         : object_string_slice_new_cstr("<anonymous>");
+        GC_push_root(&funcname);
+
+        Object *args_cursor = o->list.cdr;
+        for (size_t i = 0; i < lambda->required; i++) {
+            if (args_cursor->kind == O_NIL) {
+                return object_error_new("function %s passed too few values", funcname);
             }
+            EASSERT(args_cursor->kind == O_LIST, "invalid function call form");
+            env->slots[i] = eval_expr(e, args_cursor->list.car);
+            GC_env_write_barrier(env);
+            args_cursor = args_cursor->list.cdr;
+        }
+
+        if (lambda->variadic) {
+            /* give it an empty list if there are no variadic args */
+            if (args_cursor->kind == O_NIL) env->slots[lambda->required] = object_nil_new();
+            else env->slots[lambda->required] = _eval_list_elements(e, args_cursor);
+            GC_env_write_barrier(env);
+        } else if (args_cursor->kind != O_NIL) {
+            return object_error_new("function %s passed too many values", funcname);
         }
 
-        Object *res = eval_expr(env, f->function.body);
-        return res;
+        GC_pop_roots(2);
+        Object *ret = vm_execute(env, f->function.lambda);
+        env_pop_frames(frames);
+        return ret;
     }
 }
 
-static Object *_builtin_print_gc_status(Env *e, Object *o)
+static Object *_prim_print_gc_status(Object **argv, size_t argc)
 {
     GC_debug_print_status();
     return object_nil_new();
 }
 
-static Object *_builtin_error(Env *e, Object *o)
+static Object *_prim_error(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "error requires an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to error");
-    Object *error = eval_expr(e, o->list.car);
-    EASSERT_TYPE("error", error, O_STR);
-    return object_error_new_from_string_slice(error);
+    EASSERT_TYPE("error", argv[0], O_STR);
+    return object_error_new_from_string_slice(argv[0]);
 }
 
 static Object *_builtin_lambda(Env *e, Object *o)
@@ -467,9 +587,7 @@ static Object *_builtin_lambda(Env *e, Object *o)
             EASSERT_TYPE("\\", cursor, O_LIST);
             EASSERT_TYPE("\\", cursor->list.car, O_IDENT);
             EASSERT(cursor->list.car->eval, "\\: all arguments must be evaluated (did you add a quote somewhere?)");
-            char ampersand[] = "&";
-            if (cursor->list.car->str.len == strlen(ampersand) 
-                    && memcmp(cursor->list.car->str.ptr, ampersand, cursor->list.car->str.len) == 0) {
+            if (IDENT_EQ(cursor->list.car, ampersand_ident)) {
                 EASSERT(cursor->list.cdr->kind == O_LIST, "\\: missing argument after &");
                 EASSERT_TYPE("\\", cursor->list.cdr->list.car, O_IDENT);
                 EASSERT(cursor->list.cdr->list.cdr->kind == O_NIL, "\\: too many arguments after & (expected 1)");
@@ -481,7 +599,41 @@ static Object *_builtin_lambda(Env *e, Object *o)
 
     Object *body = o->list.cdr->list.car;
 
-    return object_function_new(e, arguments, body);
+    return object_function_new(e, resolve_lambda(e, arguments, body));
+}
+
+static Object *_eval_local(Env *e, Object *o)
+{
+    Env *frame = e;
+    for (uint32_t i = 0; i < o->local.depth; i++) {
+        /* something was def'd into a frame in between, which might
+         * shadow the binding, so look it up by name instead */
+        if (frame->store) return env_get(e, o->local.ident);
+        frame = frame->parent;
+    }
+
+    Object *value = frame->slots[o->local.slot];
+    /* not bound yet, like a let binding refering to a later one */
+    if (value == NULL) return env_get(e, o->local.ident);
+    return value;
+}
+
+static Object *_eval_let(Env *e, Object *o)
+{
+    struct Let *let = o->let;
+    /* recur is only a jump in compiled code */
+    if (let->loop) return vm_execute(e, resolve_wrap(o, o));
+
+    size_t frames = env_frame_count();
+    Env *frame = env_push_frame(e, o);
+    for (size_t i = 0; i < let->binding_count; i++) {
+        frame->slots[let->binding_slots[i]] = eval_expr(frame, let->binding_values[i]);
+        GC_env_write_barrier(frame);
+    }
+
+    Object *ret = eval_expr(frame, let->resolved);
+    env_pop_frames(frames);
+    return ret;
 }
 
 static Object *_builtin_if(Env *e, Object *o)
@@ -501,42 +653,9 @@ static Object *_builtin_if(Env *e, Object *o)
     }
 }
 
-static Object *_builtin_equals(Env *e, Object *o)
+static Object *_prim_equals(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "=: needs two arguments");
-    Object *a = eval_expr(e, o->list.car);
-    EASSERT(o->list.cdr->kind != O_NIL, "=: needs two arguments");
-    Object *b = eval_expr(e, o->list.cdr->list.car);
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to =");
-
-    if (a->kind != b->kind) return object_nil_new();
-    else {
-        switch (a->kind) {
-            case O_NUM:
-                return mpz_cmp(a->num, b->num) == 0 ? object_num_new(1) : object_nil_new();
-                break;
-
-            case O_STR: case O_IDENT: case O_ERROR:
-                return a->str.len == b->str.len && memcmp(a->str.ptr, b->str.ptr, a->str.len) == 0 ? object_num_new(1) : object_nil_new();
-                break;
-
-            case O_LIST:
-                return object_error_new("=: list comparisons arent implemented yet :)");
-                break;
-
-            case O_NIL: /* only one state so its always equal to any other nil */
-                return object_num_new(1); 
-                break;
-
-            case O_BUILTIN: case O_FUNCTION:
-                return object_error_new("=: function comparisons arent implemented :)");
-                break;
-
-            case O_CHAR:
-                return a->character == b->character ? object_num_new(1) : object_nil_new();
-         }
-    }
-    assert(0 && "infallible");
+    return object_equal(argv[0], argv[1]) ? object_num_new(1) : object_nil_new();
 }
 
 /* this is basically copy-pasted from object.c but the quotes from the strings are removed */
@@ -549,11 +668,11 @@ static inline void _print_slice(struct StringSlice s)
 static void print(Object *o)
 {
     switch (o->kind) {
-            case O_STR:
+            case O_STR: case O_STRING_BUILDER:
                 _print_slice(o->str);
                 break;
             case O_NUM: {
-                mpz_out_str(stdout, 10, o->num);
+                num_out(stdout, &o->num);
             } break;
             case O_IDENT:
                 _print_slice(o->str);
@@ -578,65 +697,81 @@ static void print(Object *o)
                 _print_slice(o->str);
                 break;
             case O_BUILTIN:
-                printf("builtin <%p>", o->builtin);
+                if (o->prim) printf("builtin <%s>", o->prim->name);
+                else printf("builtin <%p>", o->builtin);
                 break;
             case O_FUNCTION:
-                print(o->function.arguments);
+                print(o->function.lambda);
+                break;
+            case O_LAMBDA:
+                print(o->lambda->arguments);
                 printf(" -> ");
-                print(o->function.body);
+                print(o->lambda->body);
+                break;
+            case O_LOCAL: case O_LET:
+                object_print(o);
                 break;
             case O_CHAR:
                 putchar(o->character);
                 break;
+            case O_VECTOR:
+                printf("#(");
+                for (uint32_t i = 0; i < o->vector.len; i++) {
+                    if (i > 0) putchar(' ');
+                    print(o->vector.items[i]);
+                }
+                printf(")");
+                break;
+            case O_MAP: case O_SET: {
+                printf(o->kind == O_MAP ? "{" : "#{");
+                MapIter it;
+                map_iter_init(&it, o);
+                Object *key, *value;
+                for (bool first = true; map_iter_next(&it, &key, &value); first = false) {
+                    if (!first) putchar(' ');
+                    print(key);
+                    if (o->kind == O_MAP) {
+                        putchar(' ');
+                        print(value);
+                    }
+                }
+                printf("}");
+            } break;
         }
 }
 
-static Object *_builtin_print(Env *e, Object *o)
+static Object *_prim_print(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "print: needs an argument");
-    while (o->kind == O_LIST) {
-        print(eval_expr(e, o->list.car));
-        o = o->list.cdr;
-    }
+    for (size_t i = 0; i < argc; i++)
+        print(argv[i]);
     fflush(stdout);
     return object_nil_new();
 }
 
-static Object *_builtin_println(Env *e, Object *o)
+static Object *_prim_println(Object **argv, size_t argc)
 {
-    while (o->kind == O_LIST) {
-        print(eval_expr(e, o->list.car));
-        o = o->list.cdr;
-    }
+    for (size_t i = 0; i < argc; i++)
+        print(argv[i]);
     putchar('\n');
     return object_nil_new();
 }
 
-static Object *_builtin_mod(Env *e, Object *o)
+static Object *_prim_mod(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "mod: needs two arguments");
-    EASSERT(o->list.cdr->kind == O_LIST, "mod: needs two arguments");
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to mod");
-
-    Object *lhs = eval_expr(e, o->list.car);
-    Object *rhs = eval_expr(e, o->list.cdr->list.car);
-
+    Object *lhs = argv[0], *rhs = argv[1];
     EASSERT_TYPE("mod", lhs, O_NUM);
     EASSERT_TYPE("mod", rhs, O_NUM);
-    EASSERT(mpz_cmp_si(rhs->num, 0) != 0, "mod: integer modulo by zero");
+    EASSERT(num_sgn(&rhs->num) != 0, "mod: integer modulo by zero");
     
-    Object *r = object_num_new(0);
-    mpz_mod(r->num, lhs->num, rhs->num);
-    return r;
+    struct Num r;
+    num_init_si(&r, 0);
+    num_mod(&r, &lhs->num, &rhs->num);
+    return object_num_new_num(&r);
 }
 
-static Object *_builtin_not(Env *e, Object *o)
+static Object *_prim_not(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "not: needs an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to not");
-
-    Object *boolean = eval_expr(e, o->list.car);
-    return boolean->kind == O_NIL ? object_num_new(1) : object_nil_new();
+    return argv[0]->kind == O_NIL ? object_num_new(1) : object_nil_new();
 }
 
 static Object *_builtin_and(Env *e, Object *o)
@@ -665,32 +800,18 @@ static Object *_builtin_or(Env *e, Object *o)
     assert(0 && "unreachable");
 }
 
-static Object *_builtin_lt(Env *e, Object *o)
+static Object *_prim_lt(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "<: needs two arguments");
-    EASSERT(o->list.cdr->kind == O_LIST, "<: needs two arguments");
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to <");
-
-    Object *lhs = eval_expr(e, o->list.car);
-    EASSERT_TYPE("<", lhs, O_NUM);
-    Object *rhs = eval_expr(e, o->list.cdr->list.car);
-    EASSERT_TYPE("<", rhs, O_NUM);
-
-    return  mpz_cmp(lhs->num, rhs->num) < 0 ? object_num_new(1) : object_nil_new();
+    EASSERT_TYPE("<", argv[0], O_NUM);
+    EASSERT_TYPE("<", argv[1], O_NUM);
+    return num_cmp(&argv[0]->num, &argv[1]->num) < 0 ? object_num_new(1) : object_nil_new();
 }
 
-static Object *_builtin_gt(Env *e, Object *o)
+static Object *_prim_gt(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, ">: needs two arguments");
-    EASSERT(o->list.cdr->kind == O_LIST, ">: needs two arguments");
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to >");
-
-    Object *lhs = eval_expr(e, o->list.car);
-    EASSERT_TYPE(">", lhs, O_NUM);
-    Object *rhs = eval_expr(e, o->list.cdr->list.car);
-    EASSERT_TYPE(">", rhs, O_NUM);
-
-    return  mpz_cmp(lhs->num, rhs->num) > 0 ? object_num_new(1) : object_nil_new();
+    EASSERT_TYPE(">", argv[0], O_NUM);
+    EASSERT_TYPE(">", argv[1], O_NUM);
+    return num_cmp(&argv[0]->num, &argv[1]->num) > 0 ? object_num_new(1) : object_nil_new();
 }
 
 static Object *_builtin_load(Env *e, Object *o)
@@ -717,27 +838,41 @@ static Object *_builtin_load(Env *e, Object *o)
     return object_nil_new();
 }
 
-static Object *_builtin_let(Env *e, Object *o)
+/* let and loop take the same form */
+static Object *_eval_let_form(Env *e, Object *o, const char *name, bool loop)
 {
-    EASSERT(o->kind == O_LIST, "let: needs at least two arguments");
-    EASSERT(o->list.cdr->kind == O_LIST, "let: needs at least two arguments");
+    EASSERT(o->kind == O_LIST, "%sc: needs at least two arguments", name);
+    EASSERT(o->list.cdr->kind == O_LIST, "%sc: needs at least two arguments", name);
 
-    Env *new_env = env_new(e);
     Object *vars = o->list.car;
     while (vars->kind == O_LIST) {
         Object *ident = vars->list.car;
         if (ident->kind != O_IDENT) {
-            return object_error_new("let: exepected identifier in argslist, got %sc", object_type_as_string(ident->kind));
+            return object_error_new("%sc: exepected identifier in argslist, got %sc", name, object_type_as_string(ident->kind));
         }
-        EASSERT(vars->list.cdr->kind == O_LIST, "let: needs an even number of variable declarations");
-        Object *value = eval_expr(new_env, vars->list.cdr->list.car);
-        env_put(new_env, ident, value);
-        
+        EASSERT(vars->list.cdr->kind == O_LIST, "%sc: needs an even number of variable declarations", name);
         vars = vars->list.cdr->list.cdr;
     }
 
-    Object *ret = eval_expr(new_env, o->list.cdr->list.car);
-    return ret;
+    return _eval_let(e, resolve_let(e, o->list.car, o->list.cdr->list.car, loop));
+}
+
+static Object *_builtin_let(Env *e, Object *o)
+{
+    return _eval_let_form(e, o, "let", false);
+}
+
+/* (loop (name value ...) body) is a let, where (recur value ...) in tail
+ * position of the body binds the names again and runs the body again */
+static Object *_builtin_loop(Env *e, Object *o)
+{
+    return _eval_let_form(e, o, "loop", true);
+}
+
+/* the compiler turns the recurs it can into jumps (see compile.c) */
+static Object *_builtin_recur(Env *e, Object *o)
+{
+    return object_error_new("recur: expected to be in tail position of a loop, with a value for each of its bindings");
 }
 
 static Object *_builtin_do(Env *e, Object *o)
@@ -767,23 +902,19 @@ static Object *_builtin_cond(Env *e, Object *o)
     return object_nil_new();
 }
 
-static Object *_builtin_input(Env *e, Object *o)
+static Object *_prim_input(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_NIL, "too many arguments passed to input");
-
     Object *ret = object_new_generic();
     ret->kind = O_STR;
     ret->str.capacity = 10;
     ret->str.len = 0;
-    ret->str.ptr = malloc(sizeof(char) * ret->str.capacity);
-    CHECK_ALLOC(ret->str.ptr);
+    ret->str.ptr = heap_alloc(sizeof(char) * ret->str.capacity);
 
     int ch;
     while ((ch = getchar()) != '\n') {
         if (ret->str.len >= ret->str.capacity) {
+            ret->str.ptr = heap_realloc(ret->str.ptr, ret->str.capacity, ret->str.capacity * 2);
             ret->str.capacity *= 2;
-            ret->str.ptr = realloc(ret->str.ptr, sizeof(char) * ret->str.capacity);
-            CHECK_ALLOC(ret->str.ptr);
         }
 
         ret->str.ptr[ret->str.len++] = (char)ch;
@@ -792,53 +923,50 @@ static Object *_builtin_input(Env *e, Object *o)
     return ret;
 }
 
-static Object *_builtin_num(Env *e, Object *o)
+static Object *_prim_num(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "num: needs an argument");
-    Object *str = eval_expr(e, o->list.car);
+    Object *str = argv[0];
 
     if (str->kind == O_NUM) return str;
     if (str->kind != O_STR) 
-        str = _builtin_string(e, object_list_new(str, object_nil_new()));
+        str = _prim_string(&str, 1);
     assert(str->kind == O_STR);
 
-    EASSERT(o->list.cdr->kind == O_NIL, "to many arguments passed to num");
-
     char *cstr = object_string_slice_to_cstr(str);
     
-    Object *ret = object_num_new(0);
-    if (mpz_set_str(ret->num, cstr, 10) != 0) {
-        free(cstr);
+    struct Num n;
+    bool ok = num_init_str(&n, cstr);
+    free(cstr);
+    if (!ok) {
+        num_clear(&n);
         return object_error_new("num: couldnt convert to number");
     }
 
-    free(cstr);
-    return ret;
+    return object_num_new_num(&n);
 }
 
-static Object *_builtin_rand(Env *e, Object *o)
+static Object *_prim_rand(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "rand: needs two arguments");
-    Object *lower_bound = eval_expr(e, o->list.car);
+    Object *lower_bound = argv[0], *upper_bound = argv[1];
     EASSERT_TYPE("rand", lower_bound, O_NUM);
-    EASSERT(o->list.cdr->kind == O_LIST, "rand: needs two arguments");
-    Object *upper_bound = eval_expr(e, o->list.cdr->list.car);
     EASSERT_TYPE("rand", upper_bound, O_NUM);
-    EASSERT(o->list.cdr->list.cdr->kind == O_NIL, "too many arguments passed to rand");
 
     /* x..=y
      * 0..=y
      * (0..(y-x+1))+ x 
      */
 
-    mpz_t upper_bound_adjusted;
+    mpz_t upper_bound_adjusted, lower_tmp, upper_tmp;
     mpz_init(upper_bound_adjusted);
 
-    mpz_sub(upper_bound_adjusted, upper_bound->num, lower_bound->num);
+    mpz_srcptr lower = num_view(&lower_bound->num, lower_tmp);
+    mpz_sub(upper_bound_adjusted, num_view(&upper_bound->num, upper_tmp), lower);
+    num_view_done(&upper_bound->num, upper_tmp);
     mpz_add_ui(upper_bound_adjusted, upper_bound_adjusted, 1);
 
     if (mpz_cmp_si(upper_bound_adjusted, 0) <= 0) {
         mpz_clear(upper_bound_adjusted);
+        num_view_done(&lower_bound->num, lower_tmp);
         return object_error_new("rand: lower bound is equal or heigher than upper bound");
     }
 
@@ -846,42 +974,39 @@ static Object *_builtin_rand(Env *e, Object *o)
     mpz_init(res);
     mpz_urandomm(res, randstate, upper_bound_adjusted);
 
-    Object *ret = object_num_new(0);
-    mpz_add(ret->num, res, lower_bound->num);
+    mpz_add(res, res, lower);
+    num_view_done(&lower_bound->num, lower_tmp);
+
+    struct Num ret;
+    num_init_si(&ret, 0);
+    num_set_mpz(&ret, res);
     mpz_clear(upper_bound_adjusted);
     mpz_clear(res);
 
-    return ret;
+    return object_num_new_num(&ret);
 }
 
-static Object *_builtin_ident(Env *e, Object *o)
+static Object *_prim_ident(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "ident: needs an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to ident");
-    
-    Object *ident = eval_expr(e, o->list.car);
+    Object *ident = argv[0];
     if (ident->kind == O_IDENT) return ident;
 
     if (ident->kind != O_STR)
-        ident = _builtin_string(e, object_list_new(ident, object_nil_new()));
+        ident = _prim_string(&ident, 1);
     assert(ident->kind == O_STR);
 
     EASSERT_TYPE("ident", ident, O_STR);
     
-    Object *ret = object_shallow_copy(ident);
-    ret->kind = O_IDENT;
-    ret->eval = false;
-    return ret;
+    Object *ret = object_ident_new(ident->str.ptr, ident->str.len);
+    return object_ident_with_eval(ret, false);
 }
 
-static Object *_builtin_char_list(Env *e, Object *o)
+static Object *_prim_char_list(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "char-list: needs an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to char-list");
-    Object *str = eval_expr(e, o->list.car);
+    Object *str = argv[0];
     /* dont know if this is the best way to do it but whateverr */
     if (str->kind != O_STR) 
-        str = _builtin_string(e, object_list_new(str, object_nil_new()));
+        str = _prim_string(&str, 1);
     assert(str->kind == O_STR);
 
     if (str->str.len == 0) return object_nil_new();
@@ -904,11 +1029,9 @@ static Object *_builtin_char_list(Env *e, Object *o)
     return ret;
 }
 
-static Object *_builtin_string(Env *e, Object *o)
+static Object *_prim_string(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "string: needs an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to string");
-    Object *to_str = eval_expr(e, o->list.car);
+    Object *to_str = argv[0];
 
     switch (to_str->kind) {
         case O_LIST: {
@@ -926,8 +1049,7 @@ static Object *_builtin_string(Env *e, Object *o)
             Object *ret = object_new_generic();
             ret->kind = O_STR;
             ret->str.len = ret->str.capacity = str_size;
-            ret->str.ptr = malloc(sizeof(char) * str_size);
-            CHECK_ALLOC(ret->str.ptr);
+            ret->str.ptr = heap_alloc(sizeof(char) * str_size);
 
             size_t i = 0;
             while (to_str->kind == O_LIST) {
@@ -940,16 +1062,17 @@ static Object *_builtin_string(Env *e, Object *o)
         case O_STR: {
             return to_str;
         } break;
+        case O_STRING_BUILDER: {
+            return object_string_slice_new(to_str->str.ptr, to_str->str.len);
+        } break;
         case O_NIL: {
             return object_string_slice_new_cstr("");
         } break;
         case O_IDENT: {
-            Object *ret = object_shallow_copy(to_str);
-            ret->kind = O_STR;
-            return ret;
+            return object_string_slice_new(to_str->str.ptr, to_str->str.len);
         } break;
         case O_NUM: {
-            char *mpz_out = mpz_get_str(NULL, 10, to_str->num);
+            char *mpz_out = num_get_str(&to_str->num);
             Object *ret = object_string_slice_new_cstr(mpz_out);
             free(mpz_out);
             return ret;
@@ -962,9 +1085,10 @@ static Object *_builtin_string(Env *e, Object *o)
         case O_CHAR: {
             return object_string_slice_new(&to_str->character, 1);
         } break;
-        case O_BUILTIN: case O_FUNCTION: {
+        case O_BUILTIN: case O_FUNCTION: case O_LOCAL: case O_LAMBDA: case O_LET: case O_VECTOR:
+        case O_MAP: case O_SET: {
             return object_error_new("to-string functionality is not implemented for %scs", 
-                    object_type_as_string(o->kind));
+                    object_type_as_string(to_str->kind));
         } break;
     }
 
@@ -972,16 +1096,11 @@ static Object *_builtin_string(Env *e, Object *o)
     return NULL;
 }
 
-static Object *_builtin_typeof(Env *e, Object *o)
+static Object *_prim_typeof(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "type-of: needs an argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to type-of");
-
-    Object *obj = eval_expr(e, o->list.car);
-     
+    Object *obj = argv[0];
     Object *ret = object_ident_new_cstr(object_type_as_string(obj->kind));
-    ret->eval = false;
-    return ret;
+    return object_ident_with_eval(ret, false);
 }
 
 static Object *_builtin_import_shared(Env *e, Object *o)
@@ -1007,9 +1126,17 @@ static Object *_builtin_import_shared(Env *e, Object *o)
         
         char *to_import_cstr = object_string_slice_to_cstr(to_import);
 
-        Builtin f = dlsym(handle, to_import_cstr); 
+        /* a primitive is exported as a PrimitiveDef with the suffix */
+        char *prim_cstr = malloc(strlen(to_import_cstr) + sizeof(PRIMITIVE_EXPORT_SUFFIX));
+        CHECK_ALLOC(prim_cstr);
+        strcpy(prim_cstr, to_import_cstr);
+        strcat(prim_cstr, PRIMITIVE_EXPORT_SUFFIX);
+        const PrimitiveDef *prim = dlsym(handle, prim_cstr);
+        free(prim_cstr);
+
+        Builtin f = prim ? NULL : (Builtin)dlsym(handle, to_import_cstr);
         free(to_import_cstr);
-        if (f == NULL) {
+        if (prim == NULL && f == NULL) {
             dlclose(handle);
             return object_error_new("import-shared: could not find \"%s\"", to_import);
             // I dont think dlerror's returned string's lifetime fits our usecase and I dont think
@@ -1017,7 +1144,7 @@ static Object *_builtin_import_shared(Env *e, Object *o)
             // extra dlerror diagnostic
             //EASSERT(f != NULL, "import-shared: could not find \"%s\": {%sc}", to_import, dlerror());
         }
-        Object *f_ = object_builtin_new(f);
+        Object *f_ = prim ? object_primitive_new(prim) : object_builtin_new(f);
         env_put(e, object_ident_new(to_import->str.ptr, to_import->str.len), f_);
 
         cursor = cursor->list.cdr;
@@ -1028,14 +1155,17 @@ static Object *_builtin_import_shared(Env *e, Object *o)
 }
 
 
-static Object *_builtin_read(Env *e, Object *o)
+static Object *_prim_read(Object **argv, size_t argc)
 {
-    EASSERT(o->kind == O_LIST, "read: needs one argument");
-    EASSERT(o->list.cdr->kind == O_NIL, "too many arguments passed to read");
-    Object *str = eval_expr(e, o->list.car);
+    Object *str = argv[0];
     EASSERT_TYPE("read", str, O_STR);
 
-    Arena *a = arena_new(sizeof(Parser) + sizeof(Lexer) + sizeof(Token) * 10 + (str->str.len + 1) * sizeof(char)); // approximate guess to how big the arena should be
+    /* read doesn't evaluate anything while it parses, so one arena does
+     * for all of them. It's rewound after, the chunks are kept for the
+     * next read */
+    static Arena *a = NULL;
+    if (a == NULL) a = arena_new(0);
+    ArenaCheckpoint checkpoint = arena_checkpoint(a);
 
     // lexer uses cstring so we need to convert the string slice unfortunately
     char *cstr = NULL;
@@ -1051,8 +1181,564 @@ static Object *_builtin_read(Env *e, Object *o)
     Parser *parser = parser_new(lex, a);
 
     Object *ret = parser_parse(parser);
-    ret->eval = false;
+    ret = object_with_eval(ret, false);
+
+    arena_rewind(a, checkpoint);
+    return ret;
+}
+
+/* the list functions of the standard library, done in a loop instead of
+ * recursing through the interpreter. They behave like the deeprose versions
+ * they replaced (see programs/list-reference.deeprose) */
+
+/* builds a list front to back, it's rooted while it's built */
+typedef struct { Object *head, *tail; } ListBuilder;
+
+static void _list_builder_init(ListBuilder *b)
+{
+    b->head = b->tail = object_nil_new();
+    GC_push_root(&b->head);
+}
+
+static void _list_builder_append(ListBuilder *b, Object *value)
+{
+    Object *node = object_list_new(value, object_nil_new());
+    node->eval = false;
+    if (b->head->kind == O_NIL) {
+        b->head = node;
+    } else {
+        b->tail->list.cdr = node;
+        /* the gc may have run and promoted the list */
+        GC_write_barrier(b->tail);
+    }
+    b->tail = node;
+}
+
+static Object *_list_builder_finish(ListBuilder *b)
+{
+    GC_pop_roots(1);
+    return b->head;
+}
 
-    arena_destroy(a);
+/* the elements of xs in reverse, for the functions that work from the
+ * back. It has to be rooted by the caller */
+static Object *_reversed(const char *f_name, Object *xs)
+{
+    Object *ret = object_nil_new();
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) {
+        ret = object_list_new(xs->list.car, ret);
+        ret->eval = false;
+    }
+    EASSERT(xs->kind == O_NIL, "%sc: expected list, got %sc", f_name, object_type_as_string(xs->kind));
     return ret;
 }
+
+static Object *_prim_map(Object **argv, size_t argc)
+{
+    Object *f = argv[0], *xs = argv[1];
+    ListBuilder b;
+    _list_builder_init(&b);
+    for (; xs->kind == O_LIST; xs = xs->list.cdr)
+        _list_builder_append(&b, vm_call(f, &xs->list.car, 1));
+    EASSERT(xs->kind == O_NIL, "map: expected list, got %sc", object_type_as_string(xs->kind));
+    return _list_builder_finish(&b);
+}
+
+static Object *_prim_filter(Object **argv, size_t argc)
+{
+    Object *pred = argv[0], *xs = argv[1];
+    ListBuilder b;
+    _list_builder_init(&b);
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) {
+        if (vm_call(pred, &xs->list.car, 1)->kind != O_NIL)
+            _list_builder_append(&b, xs->list.car);
+    }
+    EASSERT(xs->kind == O_NIL, "filter: expected list, got %sc", object_type_as_string(xs->kind));
+    return _list_builder_finish(&b);
+}
+
+static Object *_prim_all(Object **argv, size_t argc)
+{
+    Object *pred = argv[0], *xs = argv[1];
+    EASSERT(xs->kind != O_NIL, "all: empty list");
+    EASSERT_TYPE("all?", xs, O_LIST);
+
+    Object *ret;
+    for (;;) {
+        ret = vm_call(pred, &xs->list.car, 1);
+        xs = xs->list.cdr;
+        if (ret->kind == O_NIL || xs->kind == O_NIL) return ret;
+        EASSERT_TYPE("all?", xs, O_LIST);
+    }
+}
+
+static Object *_prim_foldl(Object **argv, size_t argc)
+{
+    Object *f = argv[0], *accum = argv[1], *xs = argv[2];
+    GC_push_root(&accum);
+    for (; xs->kind == O_LIST; xs = xs->list.cdr)
+        accum = vm_call(f, (Object *[]) { xs->list.car, accum }, 2);
+    GC_pop_roots(1);
+    EASSERT(xs->kind == O_NIL, "foldl: expected list, got %sc", object_type_as_string(xs->kind));
+    return accum;
+}
+
+static Object *_prim_foldr(Object **argv, size_t argc)
+{
+    Object *f = argv[0], *accum = argv[1];
+    Object *xs = _reversed("foldr", argv[2]);
+    GC_push_root(&xs);
+    GC_push_root(&accum);
+    for (; xs->kind == O_LIST; xs = xs->list.cdr)
+        accum = vm_call(f, (Object *[]) { xs->list.car, accum }, 2);
+    GC_pop_roots(2);
+    return accum;
+}
+
+static Object *_prim_len(Object **argv, size_t argc)
+{
+    Object *xs = argv[0];
+    int64_t len = 0;
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) len++;
+    EASSERT(xs->kind == O_NIL, "len: expected list, got %sc", object_type_as_string(xs->kind));
+    return object_num_new(len);
+}
+
+static Object *_prim_reverse(Object **argv, size_t argc)
+{
+    return _reversed("reverse", argv[0]);
+}
+
+static Object *_prim_take(Object **argv, size_t argc)
+{
+    Object *n = argv[0], *xs = argv[1];
+    EASSERT_TYPE("take", n, O_NUM);
+
+    /* counts down like the recursive version, so a negative count runs
+     * off the end of the list */
+    struct Num i;
+    num_init_copy(&i, &n->num);
+    struct Num one;
+    num_init_si(&one, 1);
+
+    ListBuilder b;
+    _list_builder_init(&b);
+    for (; num_sgn(&i) != 0; xs = xs->list.cdr) {
+        if (xs->kind != O_LIST) {
+            num_clear(&i);
+            GC_pop_roots(1);
+            return object_error_new("take: expected list, got %sc", object_type_as_string(xs->kind));
+        }
+        _list_builder_append(&b, xs->list.car);
+        num_sub(&i, &i, &one);
+    }
+    num_clear(&i);
+    return _list_builder_finish(&b);
+}
+
+/* the rest of xs after n elements in *rest, false if it ran into
+ * something that isn't a list first, *rest is that then */
+static bool _drop(const struct Num *n, Object *xs, Object **rest)
+{
+    struct Num i;
+    num_init_copy(&i, n);
+    struct Num one;
+    num_init_si(&one, 1);
+
+    bool ok = true;
+    for (; num_sgn(&i) != 0; xs = xs->list.cdr) {
+        if (xs->kind != O_LIST) { ok = false; break; }
+        num_sub(&i, &i, &one);
+    }
+    num_clear(&i);
+    *rest = xs;
+    return ok;
+}
+
+static Object *_prim_drop(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("drop", argv[0], O_NUM);
+    Object *rest = NULL;
+    EASSERT(_drop(&argv[0]->num, argv[1], &rest), "drop: expected list, got %sc",
+            object_type_as_string(rest->kind));
+    return rest;
+}
+
+static Object *_prim_nth(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("nth", argv[0], O_NUM);
+    /* counted from 1 */
+    struct Num n;
+    num_init_si(&n, -1);
+    num_add(&n, &n, &argv[0]->num);
+    Object *rest = NULL;
+    _drop(&n, argv[1], &rest);
+    num_clear(&n);
+    EASSERT(rest->kind == O_LIST, "nth: expected list, got %sc", object_type_as_string(rest->kind));
+    return rest->list.car;
+}
+
+static Object *_prim_range(Object **argv, size_t argc)
+{
+    Object *start = argv[0], *end = argv[1];
+    EASSERT_TYPE("range", start, O_NUM);
+    EASSERT_TYPE("range", end, O_NUM);
+    EASSERT(num_cmp(&start->num, &end->num) <= 0, "range: start > end");
+
+    struct Num i;
+    num_init_copy(&i, &start->num);
+    struct Num one;
+    num_init_si(&one, 1);
+
+    ListBuilder b;
+    _list_builder_init(&b);
+    for (;;) {
+        struct Num value;
+        num_init_copy(&value, &i);
+        _list_builder_append(&b, object_num_new_num(&value));
+        if (num_cmp(&i, &end->num) == 0) break;
+        num_add(&i, &i, &one);
+    }
+    num_clear(&i);
+    return _list_builder_finish(&b);
+}
+
+/* (dotimes n f) calls f with 0 up to n - 1, without making a list */
+static Object *_prim_dotimes(Object **argv, size_t argc)
+{
+    Object *n = argv[0], *f = argv[1];
+    EASSERT_TYPE("dotimes", n, O_NUM);
+
+    struct Num i;
+    num_init_si(&i, 0);
+    struct Num one;
+    num_init_si(&one, 1);
+    while (num_cmp(&i, &n->num) < 0) {
+        struct Num value;
+        num_init_copy(&value, &i);
+        Object *arg = object_num_new_num(&value);
+        /* i leaks if f errors, but it's only malloc'd past the range of a long */
+        vm_call(f, &arg, 1);
+        num_add(&i, &i, &one);
+    }
+    num_clear(&i);
+    return object_nil_new();
+}
+
+static Object *_prim_elem(Object **argv, size_t argc)
+{
+    Object *xs = argv[1];
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) {
+        if (object_equal(argv[0], xs->list.car)) return object_num_new(1);
+    }
+    EASSERT(xs->kind == O_NIL, "elem?: expected list, got %sc", object_type_as_string(xs->kind));
+    return object_nil_new();
+}
+
+static Object *_prim_concat(Object **argv, size_t argc)
+{
+    if (argc == 0) return object_nil_new();
+
+    bool strings = true, lists = true;
+    for (size_t i = 0; i < argc; i++) {
+        if (argv[i]->kind != O_STR) strings = false;
+        if (argv[i]->kind != O_LIST && argv[i]->kind != O_NIL) lists = false;
+    }
+
+    if (strings) return _prim_string_append(argv, argc);
+
+    if (lists) {
+        /* everything but the last list is copied, it becomes the tail */
+        ListBuilder b;
+        _list_builder_init(&b);
+        for (size_t i = 0; i + 1 < argc; i++)
+            for (Object *xs = argv[i]; xs->kind == O_LIST; xs = xs->list.cdr)
+                _list_builder_append(&b, xs->list.car);
+        Object *last = argv[argc - 1];
+        if (b.head->kind == O_NIL) {
+            GC_pop_roots(1);
+            return last;
+        }
+        b.tail->list.cdr = last;
+        GC_write_barrier(b.tail);
+        return _list_builder_finish(&b);
+    }
+
+    return object_error_new("concat: expected only strings or lists, got %sc.", object_type_as_string(argv[0]->kind));
+}
+
+/* vectors are indexed from 0 */
+
+static Object *_prim_vector(Object **argv, size_t argc)
+{
+    EASSERT(argc <= UINT32_MAX, "vector: too many values");
+    Object *ret = object_vector_new(argc);
+    for (size_t i = 0; i < argc; i++) ret->vector.items[i] = argv[i];
+    ret->vector.len = (uint32_t)argc;
+    return ret;
+}
+
+/* checks that i is an index into the vector v, NULL if it is */
+static Object *_vector_index(const char *f_name, Object *v, Object *i, uint32_t *index)
+{
+    if (v->kind != O_VECTOR)
+        return object_error_new("%sc: expected vector, got %sc", f_name, object_type_as_string(v->kind));
+    if (i->kind != O_NUM)
+        return object_error_new("%sc: expected number, got %sc", f_name, object_type_as_string(i->kind));
+    long n = i->num.is_big ? -1 : i->num.small;
+    if (n < 0 || n >= (long)v->vector.len)
+        return object_error_new("%sc: index %d is out of range for a vector of length %d",
+                f_name, i, object_num_new(v->vector.len));
+    *index = (uint32_t)n;
+    return NULL;
+}
+
+static Object *_prim_vector_ref(Object **argv, size_t argc)
+{
+    uint32_t i = 0;
+    Object *error = _vector_index("vector-ref", argv[0], argv[1], &i);
+    if (error) return error;
+    return argv[0]->vector.items[i];
+}
+
+static Object *_prim_vector_set(Object **argv, size_t argc)
+{
+    uint32_t i = 0;
+    Object *error = _vector_index("vector-set!", argv[0], argv[1], &i);
+    if (error) return error;
+    argv[0]->vector.items[i] = argv[2];
+    GC_write_barrier(argv[0]);
+    return argv[0];
+}
+
+static Object *_prim_vector_push(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("vector-push!", argv[0], O_VECTOR);
+    EASSERT(argv[0]->vector.len < UINT32_MAX, "vector-push!: the vector is full");
+    object_vector_push(argv[0], argv[1]);
+    return argv[0];
+}
+
+static Object *_prim_vector_length(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("vector-length", argv[0], O_VECTOR);
+    return object_num_new(argv[0]->vector.len);
+}
+
+static Object *_prim_list_to_vector(Object **argv, size_t argc)
+{
+    size_t len = 0;
+    Object *xs = argv[0];
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) len++;
+    EASSERT(xs->kind == O_NIL, "list->vector: expected list, got %sc", object_type_as_string(xs->kind));
+    EASSERT(len <= UINT32_MAX, "list->vector: the list is too long");
+
+    Object *ret = object_vector_new(len);
+    for (xs = argv[0]; xs->kind == O_LIST; xs = xs->list.cdr)
+        ret->vector.items[ret->vector.len++] = xs->list.car;
+    return ret;
+}
+
+static Object *_prim_vector_to_list(Object **argv, size_t argc)
+{
+    Object *v = argv[0];
+    EASSERT_TYPE("vector->list", v, O_VECTOR);
+    Object *ret = object_nil_new();
+    for (uint32_t i = v->vector.len; i-- > 0;) {
+        ret = object_list_new(v->vector.items[i], ret);
+        ret->eval = false;
+    }
+    return ret;
+}
+
+static Object *_prim_hash_map(Object **argv, size_t argc)
+{
+    EASSERT(argc % 2 == 0, "hash-map: expected keys and values, got an odd number of arguments");
+    Object *ret = map_new(O_MAP);
+    for (size_t i = 0; i < argc; i += 2) ret = map_assoc(ret, argv[i], argv[i + 1]);
+    return ret;
+}
+
+static Object *_prim_hash_set(Object **argv, size_t argc)
+{
+    Object *ret = map_new(O_SET);
+    for (size_t i = 0; i < argc; i++) ret = map_assoc(ret, argv[i], argv[i]);
+    return ret;
+}
+
+static Object *_prim_assoc(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("assoc", argv[0], O_MAP);
+    return map_assoc(argv[0], argv[1], argv[2]);
+}
+
+static Object *_prim_dissoc(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("dissoc", argv[0], O_MAP);
+    return map_dissoc(argv[0], argv[1]);
+}
+
+static Object *_prim_set_add(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("set-add", argv[0], O_SET);
+    return map_assoc(argv[0], argv[1], argv[1]);
+}
+
+static Object *_prim_set_remove(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("set-remove", argv[0], O_SET);
+    return map_dissoc(argv[0], argv[1]);
+}
+
+#define EASSERT_MAP_OR_SET(f_name, m) \
+    EASSERT((m)->kind == O_MAP || (m)->kind == O_SET, f_name ": expected map or set, got %sc", \
+            object_type_as_string((m)->kind))
+
+/* the element itself for a set, the default (or nil) if it isn't there */
+static Object *_prim_get(Object **argv, size_t argc)
+{
+    EASSERT_MAP_OR_SET("get", argv[0]);
+    Object *value = map_get(argv[0], argv[1]);
+    if (value) return value;
+    return argc == 3 ? argv[2] : object_nil_new();
+}
+
+static Object *_prim_contains(Object **argv, size_t argc)
+{
+    EASSERT_MAP_OR_SET("contains?", argv[0]);
+    return map_get(argv[0], argv[1]) ? object_num_new(1) : object_nil_new();
+}
+
+static Object *_map_list(Object *m, bool keys)
+{
+    ListBuilder b;
+    _list_builder_init(&b);
+    MapIter it;
+    map_iter_init(&it, m);
+    Object *key, *value;
+    while (map_iter_next(&it, &key, &value))
+        _list_builder_append(&b, keys ? key : value);
+    return _list_builder_finish(&b);
+}
+
+static Object *_prim_keys(Object **argv, size_t argc)
+{
+    EASSERT_MAP_OR_SET("keys", argv[0]);
+    return _map_list(argv[0], true);
+}
+
+static Object *_prim_vals(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("vals", argv[0], O_MAP);
+    return _map_list(argv[0], false);
+}
+
+static Object *_prim_count(Object **argv, size_t argc)
+{
+    EASSERT_MAP_OR_SET("count", argv[0]);
+    return object_num_new(argv[0]->map.count);
+}
+
+/* the bytes of a string or char, false for anything else */
+static bool _string_part(Object *o, const char **ptr, size_t *len)
+{
+    if (o->kind == O_STR) {
+        *ptr = o->str.ptr;
+        *len = o->str.len;
+        return true;
+    }
+    if (o->kind == O_CHAR) {
+        *ptr = &o->character;
+        *len = 1;
+        return true;
+    }
+    return false;
+}
+
+/* a string of len bytes to be filled in */
+static Object *_string_of_len(size_t len)
+{
+    Object *ret = object_new_generic();
+    ret->kind = O_STR;
+    ret->str.len = ret->str.capacity = len;
+    ret->str.ptr = heap_alloc(sizeof(char) * len);
+    return ret;
+}
+
+/* strings and chars, sized up first so the result is copied into once */
+static Object *_prim_string_append(Object **argv, size_t argc)
+{
+    const char *ptr = NULL;
+    size_t len = 0, total = 0;
+    for (size_t i = 0; i < argc; i++) {
+        EASSERT(_string_part(argv[i], &ptr, &len), "string-append: expected string or char, got %sc",
+                object_type_as_string(argv[i]->kind));
+        total += len;
+    }
+    EASSERT(total <= UINT32_MAX, "string-append: the string is too long");
+
+    Object *ret = _string_of_len(total);
+    size_t at = 0;
+    for (size_t i = 0; i < argc; i++) {
+        _string_part(argv[i], &ptr, &len);
+        if (len) memcpy(ret->str.ptr + at, ptr, len);
+        at += len;
+    }
+    return ret;
+}
+
+static Object *_prim_string_join(Object **argv, size_t argc)
+{
+    const char *ptr = NULL, *sep = NULL;
+    size_t len = 0, sep_len = 0, total = 0, count = 0;
+    EASSERT(_string_part(argv[1], &sep, &sep_len), "string-join: expected string or char as the separator, got %sc",
+            object_type_as_string(argv[1]->kind));
+    Object *xs = argv[0];
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) {
+        EASSERT(_string_part(xs->list.car, &ptr, &len), "string-join: expected strings or chars, got %sc",
+                object_type_as_string(xs->list.car->kind));
+        total += len;
+        count++;
+    }
+    EASSERT(xs->kind == O_NIL, "string-join: expected list, got %sc", object_type_as_string(xs->kind));
+    if (count > 1) total += sep_len * (count - 1);
+    EASSERT(total <= UINT32_MAX, "string-join: the string is too long");
+
+    Object *ret = _string_of_len(total);
+    size_t at = 0;
+    for (xs = argv[0]; xs->kind == O_LIST; xs = xs->list.cdr) {
+        if (xs != argv[0]) {
+            if (sep_len) memcpy(ret->str.ptr + at, sep, sep_len);
+            at += sep_len;
+        }
+        _string_part(xs->list.car, &ptr, &len);
+        if (len) memcpy(ret->str.ptr + at, ptr, len);
+        at += len;
+    }
+    return ret;
+}
+
+static Object *_string_builder_append(const char *f_name, Object *b, Object **argv, size_t argc)
+{
+    const char *ptr = NULL;
+    size_t len = 0;
+    for (size_t i = 0; i < argc; i++) {
+        if (!_string_part(argv[i], &ptr, &len))
+            return object_error_new("%sc: expected string or char, got %sc", f_name, object_type_as_string(argv[i]->kind));
+        if (len > UINT32_MAX - b->str.len)
+            return object_error_new("%sc: the string is too long", f_name);
+        object_string_builder_append(b, ptr, len);
+    }
+    return b;
+}
+
+static Object *_prim_string_builder(Object **argv, size_t argc)
+{
+    return _string_builder_append("string-builder", object_string_builder_new(), argv, argc);
+}
+
+static Object *_prim_string_builder_append(Object **argv, size_t argc)
+{
+    EASSERT_TYPE("string-builder-append!", argv[0], O_STRING_BUILDER);
+    return _string_builder_append("string-builder-append!", argv[0], argv + 1, argc - 1);
+}
@@ -9,7 +9,7 @@
 
 #define EASSERT_TYPE(f_name, obj, expected_type) \
     do { if ((obj)->kind != (expected_type)) { \
-          if ((obj)->kind == O_ERROR) return o; \
+          if ((obj)->kind == O_ERROR) return (obj); \
           else return object_error_new(f_name ": expected %sc, got %sc", \
                   object_type_as_string((expected_type)), \
                   object_type_as_string((obj)->kind)); \
@@ -22,4 +22,22 @@ void env_add_default_variables(Env *e);
 int eval_program(const char *program, Env *env /*nullable*/, bool print_eval);
 Object *eval_expr(Env *e, Object *o);
 
+/* the builtins the compiler knows about (see compile.c and resolve.c).
+ * They are recognised by value, so an alias made with def works too */
+enum SpecialForm {
+    SF_NONE = 0,
+    SF_IF, SF_COND, SF_DO, SF_AND, SF_OR, SF_DEF, SF_LAMBDA, SF_LET, SF_LOOP, SF_RECUR,
+    /* called normally, but they look variables up by name at runtime */
+    SF_EVAL, SF_LOAD, SF_IMPORT_SHARED,
+};
+enum SpecialForm eval_special_form(Object *value /* nullable */);
+
+/* import-shared looks for a PrimitiveDef named after the function with
+ * this appended first, then for a Builtin with the name itself */
+#define PRIMITIVE_EXPORT_SUFFIX "_primitive"
+
+/* calls prim like the vm would, but returns NULL instead of an error.
+ * The compiler uses it to call pure primitives on constants */
+Object *eval_try_primitive(const PrimitiveDef *prim, Object **argv, size_t argc);
+
 #endif
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include "heap.h"
+#include "util.h"
+
+/* payload sizes are rounded up to one of these */
+static const size_t size_classes[] = { 16, 32, 64, 128, 256 };
+#define SIZE_CLASS_COUNT (sizeof(size_classes) / sizeof(size_classes[0]))
+#define SMALL_MAX 256
+
+typedef struct FreeChunk FreeChunk;
+struct FreeChunk { FreeChunk *next; };
+
+static struct {
+    ObjectPage *pages; /* the newest page is first */
+    Object *free_list; /* linked with free_next */
+    size_t object_pages;
+    ObjectPage *sweep_cursor; /* nullable - the next page to sweep */
+    bool (*is_garbage)(Object *);
+
+    struct {
+        char *cursor, *end; /* what's left of the newest page */
+        FreeChunk *free_list;
+        size_t pages;
+    } classes[SIZE_CLASS_COUNT];
+} heap = { 0 };
+
+Object *heap_alloc_object(void)
+{
+    /* sweeping a page is the way to find free slots before bumping */
+    while (heap.free_list == NULL && heap_sweep_page());
+
+    if (heap.free_list) {
+        Object *ret = heap.free_list;
+        heap.free_list = ret->free_next;
+        return ret;
+    }
+
+    ObjectPage *page = heap.pages;
+    if (page == NULL || page->used == HEAP_PAGE_OBJECTS) {
+        page = aligned_alloc(HEAP_PAGE_SIZE, HEAP_PAGE_SIZE);
+        CHECK_ALLOC(page);
+        page->next = heap.pages;
+        page->used = 0;
+        page->sweep_limit = 0;
+        memset(page->marks, 0, sizeof(page->marks));
+        heap.pages = page;
+        heap.object_pages++;
+    }
+    return &page->slots[page->used++];
+}
+
+void heap_free_object(Object *o)
+{
+    o->free = true;
+    o->free_next = heap.free_list;
+    heap.free_list = o;
+}
+
+void heap_start_sweep(bool (*is_garbage)(Object *))
+{
+    assert(heap.sweep_cursor == NULL);
+    /* the free slots are found again by the sweep */
+    heap.free_list = NULL;
+    heap.is_garbage = is_garbage;
+    heap.sweep_cursor = heap.pages;
+    for (ObjectPage *page = heap.pages; page; page = page->next)
+        page->sweep_limit = page->used;
+}
+
+bool heap_sweep_page(void)
+{
+    ObjectPage *page = heap.sweep_cursor;
+    if (page == NULL) return false;
+    heap.sweep_cursor = page->next;
+
+    /* the page's free slots go on the free list in address order so new
+     * objects are handed out close to each other */
+    Object *free_list = NULL;
+    Object **free_tail = &free_list;
+    for (size_t i = 0; i < page->sweep_limit; i++) {
+        Object *o = &page->slots[i];
+        if (!o->free) {
+            if (!heap.is_garbage(o)) continue;
+            o->free = true;
+        }
+        *free_tail = o;
+        free_tail = &o->free_next;
+    }
+    memset(page->marks, 0, sizeof(page->marks));
+
+    *free_tail = heap.free_list;
+    heap.free_list = free_list;
+    return true;
+}
+
+void heap_finish_sweep(void)
+{
+    while (heap_sweep_page());
+}
+
+static inline size_t _size_class(size_t size)
+{
+    size_t i = 0;
+    while (size_classes[i] < size) i++;
+    return i;
+}
+
+void *heap_alloc(size_t size)
+{
+    if (size == 0) return NULL;
+    if (size > SMALL_MAX) {
+        void *ret = malloc(size);
+        CHECK_ALLOC(ret);
+        return ret;
+    }
+
+    size_t c = _size_class(size);
+    if (heap.classes[c].free_list) {
+        FreeChunk *ret = heap.classes[c].free_list;
+        heap.classes[c].free_list = ret->next;
+        return ret;
+    }
+
+    if (heap.classes[c].cursor == heap.classes[c].end) {
+        /* pages of payloads are never given back, their chunks are reused */
+        char *page = malloc(HEAP_PAGE_SIZE);
+        CHECK_ALLOC(page);
+        heap.classes[c].cursor = page;
+        heap.classes[c].end = page + HEAP_PAGE_SIZE - HEAP_PAGE_SIZE % size_classes[c];
+        heap.classes[c].pages++;
+    }
+    void *ret = heap.classes[c].cursor;
+    heap.classes[c].cursor += size_classes[c];
+    return ret;
+}
+
+void heap_free(void *ptr, size_t size)
+{
+    if (ptr == NULL) return;
+    if (size > SMALL_MAX) {
+        free(ptr);
+        return;
+    }
+
+    size_t c = _size_class(size);
+    FreeChunk *chunk = ptr;
+    chunk->next = heap.classes[c].free_list;
+    heap.classes[c].free_list = chunk;
+}
+
+void *heap_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    if (ptr == NULL) return heap_alloc(new_size);
+    if (new_size == 0) {
+        heap_free(ptr, old_size);
+        return NULL;
+    }
+    if (old_size > SMALL_MAX && new_size > SMALL_MAX) {
+        void *ret = realloc(ptr, new_size);
+        CHECK_ALLOC(ret);
+        return ret;
+    }
+    if (old_size <= SMALL_MAX && new_size <= SMALL_MAX && _size_class(old_size) == _size_class(new_size))
+        return ptr;
+
+    void *ret = heap_alloc(new_size);
+    memcpy(ret, ptr, old_size < new_size ? old_size : new_size);
+    heap_free(ptr, old_size);
+    return ret;
+}
+
+void heap_debug_print_status(void)
+{
+    fprintf(stderr, "\tobject pages: %zu\n", heap.object_pages);
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++)
+        fprintf(stderr, "\t%zu byte pages: %zu\n", size_classes[i], heap.classes[i].pages);
+}
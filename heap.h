@@ -0,0 +1,101 @@
+#ifndef HEAP_HEADER__
+#define HEAP_HEADER__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+
+/* The heap hands out objects and small payloads (string bodies) from
+ * pages split into slots of one size, instead of a malloc per object.
+ *
+ * Objects come from their own pages. A new object is popped off the free
+ * list or bumped off the end of the newest page. Freed object slots are
+ * marked free and go back on the free list.
+ *
+ * Sweeping is lazy: heap_start_sweep only takes note of the pages there
+ * are, they are swept one at a time when the free list runs out or when
+ * the gc asks for it with heap_sweep_page. Objects made after the sweep
+ * started are never swept by it.
+ *
+ * The gc's mark bits are kept in a bitmap at the start of every page
+ * instead of in the objects. Pages are aligned to their size, so the page
+ * of an object is found by masking its address.
+ *
+ * Payloads are rounded up to a size class, every class has its own pages
+ * and free list. Anything bigger than the biggest class is malloc'd. The
+ * size given to heap_free must be the one it was allocated with, for
+ * strings that is their capacity. */
+
+#define HEAP_PAGE_SIZE (1 << 16)
+#define HEAP_PAGE_MAX_OBJECTS (HEAP_PAGE_SIZE / sizeof(Object))
+
+typedef struct ObjectPage ObjectPage;
+struct ObjectPage {
+    ObjectPage *next; /* nullable */
+    size_t used; /* slots that have been bumped off so far */
+    size_t sweep_limit; /* slots the sweep that's running has to look at */
+    uint64_t marks[(HEAP_PAGE_MAX_OBJECTS + 63) / 64];
+    Object slots[];
+};
+
+#define HEAP_PAGE_OBJECTS ((HEAP_PAGE_SIZE - sizeof(ObjectPage)) / sizeof(Object))
+
+static inline ObjectPage *heap_page_of(Object *o)
+{
+    return (ObjectPage *)((uintptr_t)o & ~(uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+/* marks o, returns if it already was */
+static inline bool heap_mark(Object *o)
+{
+    ObjectPage *page = heap_page_of(o);
+    size_t i = o - page->slots;
+    uint64_t bit = (uint64_t)1 << (i % 64);
+    bool was_marked = page->marks[i / 64] & bit;
+    page->marks[i / 64] |= bit;
+    return was_marked;
+}
+
+/* heap_mark for when several threads mark at once */
+static inline bool heap_mark_atomic(Object *o)
+{
+    ObjectPage *page = heap_page_of(o);
+    size_t i = o - page->slots;
+    uint64_t bit = (uint64_t)1 << (i % 64);
+    return __atomic_fetch_or(&page->marks[i / 64], bit, __ATOMIC_RELAXED) & bit;
+}
+
+static inline bool heap_is_marked(Object *o)
+{
+    ObjectPage *page = heap_page_of(o);
+    size_t i = o - page->slots;
+    return page->marks[i / 64] & ((uint64_t)1 << (i % 64));
+}
+
+static inline void heap_unmark(Object *o)
+{
+    ObjectPage *page = heap_page_of(o);
+    size_t i = o - page->slots;
+    page->marks[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+Object *heap_alloc_object(void);
+/* the object's payload must already be freed */
+void heap_free_object(Object *o);
+
+/* the sweep calls is_garbage on every object in the heap, the ones it
+ * returns true for are freed. is_garbage frees the object's payload.
+ * The marks of a page are cleared once it's swept */
+void heap_start_sweep(bool (*is_garbage)(Object *));
+/* returns false once every page is swept */
+bool heap_sweep_page(void);
+void heap_finish_sweep(void);
+
+void *heap_alloc(size_t size);
+void *heap_realloc(void *ptr, size_t old_size, size_t new_size);
+void heap_free(void *ptr, size_t size);
+
+void heap_debug_print_status(void);
+
+#endif
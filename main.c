@@ -10,6 +10,25 @@
 
 int main(int argc, char *argv[])
 {
+    /* gc options come first:
+     * -max-pause ms makes major collections incremental, see GC_set_max_pause
+     * -gc-threads n marks with n threads, see GC_set_threads */
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-max-pause") == 0) {
+            double ms = atof(argv[2]);
+            if (ms <= 0) { fprintf(stderr, "-max-pause expects a number of milliseconds\n"); exit(-1); }
+            GC_set_max_pause(ms);
+        } else if (strcmp(argv[1], "-gc-threads") == 0) {
+            int threads = atoi(argv[2]);
+            if (threads < 1 || threads > 256) { fprintf(stderr, "-gc-threads expects a number of threads from 1 to 256\n"); exit(-1); }
+            GC_set_threads(threads);
+        } else {
+            break;
+        }
+        argv[2] = argv[0];
+        argc -= 2; argv += 2;
+    }
+
     Env *env = env_new(NULL);
     env_add_default_variables(env);
     eval_program(stdlib, env, false);
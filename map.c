@@ -0,0 +1,264 @@
+#include <assert.h>
+#include <string.h>
+#include "map.h"
+#include "heap.h"
+
+#define MAP_MASK ((1u << MAP_BITS) - 1)
+
+static inline uint32_t _bit(uint64_t hash, unsigned shift)
+{
+    return 1u << ((hash >> shift) & MAP_MASK);
+}
+
+/* where the entry for bit is in the node */
+static inline size_t _index(Object *node, uint32_t bit)
+{
+    return __builtin_popcount(node->map.bitmap & (bit - 1));
+}
+
+/* the entries of an empty node are NULL, which memcpy doesn't take */
+static inline void _copy_entries(struct MapEntry *to, struct MapEntry *from, size_t n)
+{
+    if (n) memcpy(to, from, sizeof(struct MapEntry) * n);
+}
+
+static Object *_node_new(enum ObjectKind kind, uint32_t bitmap, uint32_t count, size_t width)
+{
+    Object *ret = object_new_generic();
+    ret->kind = kind;
+    ret->map.bitmap = bitmap;
+    ret->map.count = count;
+    ret->map.entries = heap_alloc(sizeof(struct MapEntry) * width);
+    assert(map_node_width(ret) == width);
+    return ret;
+}
+
+/* a copy of node with entry i replaced */
+static Object *_node_with(Object *node, size_t i, struct MapEntry entry, uint32_t count)
+{
+    size_t width = map_node_width(node);
+    Object *ret = _node_new(node->kind, node->map.bitmap, count, width);
+    _copy_entries(ret->map.entries, node->map.entries, width);
+    ret->map.entries[i] = entry;
+    return ret;
+}
+
+/* a copy of node with entry put in at i, for bit */
+static Object *_node_with_inserted(Object *node, size_t i, uint32_t bit, struct MapEntry entry)
+{
+    size_t width = map_node_width(node);
+    struct MapEntry *from = node->map.entries;
+    Object *ret = _node_new(node->kind, node->map.bitmap | bit, node->map.count + 1, width + 1);
+    _copy_entries(ret->map.entries, from, i);
+    ret->map.entries[i] = entry;
+    _copy_entries(ret->map.entries + i + 1, from + i, width - i);
+    return ret;
+}
+
+/* a copy of node without entry i, which is for bit */
+static Object *_node_without(Object *node, size_t i, uint32_t bit)
+{
+    size_t width = map_node_width(node);
+    struct MapEntry *from = node->map.entries;
+    Object *ret = _node_new(node->kind, node->map.bitmap & ~bit, node->map.count - 1, width - 1);
+    _copy_entries(ret->map.entries, from, i);
+    _copy_entries(ret->map.entries + i, from + i + 1, width - i - 1);
+    return ret;
+}
+
+/* a node at shift for two keys that collided one level up */
+static Object *_node_pair(enum ObjectKind kind, unsigned shift,
+        struct MapEntry a, uint64_t hash_a, struct MapEntry b, uint64_t hash_b)
+{
+    if (shift >= MAP_HASH_BITS) {
+        Object *ret = _node_new(kind, 0, 2, 2);
+        ret->map.entries[0] = a;
+        ret->map.entries[1] = b;
+        return ret;
+    }
+
+    uint32_t bit_a = _bit(hash_a, shift), bit_b = _bit(hash_b, shift);
+    if (bit_a == bit_b) {
+        Object *ret = _node_new(kind, bit_a, 2, 1);
+        ret->map.entries[0] = (struct MapEntry) {
+            .key = NULL,
+            .value = _node_pair(kind, shift + MAP_BITS, a, hash_a, b, hash_b),
+        };
+        return ret;
+    }
+
+    Object *ret = _node_new(kind, bit_a | bit_b, 2, 2);
+    ret->map.entries[bit_a < bit_b ? 0 : 1] = a;
+    ret->map.entries[bit_a < bit_b ? 1 : 0] = b;
+    return ret;
+}
+
+Object *map_new(enum ObjectKind kind)
+{
+    assert(kind == O_MAP || kind == O_SET);
+    return _node_new(kind, 0, 0, 0);
+}
+
+Object *map_get(Object *m, Object *key)
+{
+    uint64_t hash = object_hash(key);
+    Object *node = m;
+    for (unsigned shift = 0; shift < MAP_HASH_BITS; shift += MAP_BITS) {
+        uint32_t bit = _bit(hash, shift);
+        if (!(node->map.bitmap & bit)) return NULL;
+        struct MapEntry *entry = &node->map.entries[_index(node, bit)];
+        if (entry->key == NULL) {
+            node = entry->value;
+            continue;
+        }
+        return object_key_equal(entry->key, key) ? entry->value : NULL;
+    }
+
+    for (uint32_t i = 0; i < node->map.count; i++) {
+        if (object_key_equal(node->map.entries[i].key, key))
+            return node->map.entries[i].value;
+    }
+    return NULL;
+}
+
+static Object *_assoc(Object *node, unsigned shift, uint64_t hash, Object *key, Object *value)
+{
+    if (shift >= MAP_HASH_BITS) {
+        size_t i = 0;
+        while (i < node->map.count && !object_key_equal(node->map.entries[i].key, key)) i++;
+        if (i == node->map.count)
+            return _node_with_inserted(node, i, 0, (struct MapEntry) { .key = key, .value = value });
+        if (node->map.entries[i].value == value || node->kind == O_SET) return node;
+        return _node_with(node, i, (struct MapEntry) { .key = node->map.entries[i].key, .value = value },
+                node->map.count);
+    }
+
+    uint32_t bit = _bit(hash, shift);
+    size_t i = _index(node, bit);
+    if (!(node->map.bitmap & bit))
+        return _node_with_inserted(node, i, bit, (struct MapEntry) { .key = key, .value = value });
+
+    struct MapEntry entry = node->map.entries[i];
+    uint32_t count = node->map.count;
+    if (entry.key == NULL) {
+        Object *child = _assoc(entry.value, shift + MAP_BITS, hash, key, value);
+        if (child == entry.value) return node;
+        count += child->map.count - entry.value->map.count;
+        entry.value = child;
+    } else if (object_key_equal(entry.key, key)) {
+        /* the key that was there first stays */
+        if (entry.value == value || node->kind == O_SET) return node;
+        entry.value = value;
+    } else {
+        entry.value = _node_pair(node->kind, shift + MAP_BITS, entry, object_hash(entry.key),
+                (struct MapEntry) { .key = key, .value = value }, hash);
+        entry.key = NULL;
+        count++;
+    }
+    return _node_with(node, i, entry, count);
+}
+
+Object *map_assoc(Object *m, Object *key, Object *value)
+{
+    assert(m->kind == O_MAP || m->kind == O_SET);
+    return _assoc(m, 0, object_hash(key), key, value);
+}
+
+static Object *_dissoc(Object *node, unsigned shift, uint64_t hash, Object *key)
+{
+    if (shift >= MAP_HASH_BITS) {
+        for (size_t i = 0; i < node->map.count; i++) {
+            if (object_key_equal(node->map.entries[i].key, key))
+                return _node_without(node, i, 0);
+        }
+        return node;
+    }
+
+    uint32_t bit = _bit(hash, shift);
+    if (!(node->map.bitmap & bit)) return node;
+    size_t i = _index(node, bit);
+    struct MapEntry entry = node->map.entries[i];
+    if (entry.key != NULL)
+        return object_key_equal(entry.key, key) ? _node_without(node, i, bit) : node;
+
+    Object *child = _dissoc(entry.value, shift + MAP_BITS, hash, key);
+    if (child == entry.value) return node;
+    /* a node under the root always has at least two keys, when it's down
+     * to one that key takes its place */
+    if (child->map.count == 1) {
+        entry = child->map.entries[0];
+        assert(entry.key != NULL);
+    } else {
+        entry.value = child;
+    }
+    return _node_with(node, i, entry, node->map.count - 1);
+}
+
+Object *map_dissoc(Object *m, Object *key)
+{
+    assert(m->kind == O_MAP || m->kind == O_SET);
+    return _dissoc(m, 0, object_hash(key), key);
+}
+
+bool map_equal(Object *a, Object *b, bool keys)
+{
+    if (a->kind != b->kind || a->map.count != b->map.count) return false;
+
+    MapIter it;
+    map_iter_init(&it, a);
+    Object *key, *value;
+    while (map_iter_next(&it, &key, &value)) {
+        Object *other = map_get(b, key);
+        if (other == NULL) return false;
+        if (a->kind == O_MAP && !(keys ? object_key_equal(value, other) : object_equal(value, other)))
+            return false;
+    }
+    return true;
+}
+
+uint64_t map_hash(Object *m)
+{
+    /* summed so the order of the entries doesn't matter */
+    uint64_t hash = m->kind == O_SET ? 0x5e7 : 0xa5;
+    MapIter it;
+    map_iter_init(&it, m);
+    Object *key, *value;
+    while (map_iter_next(&it, &key, &value)) {
+        uint64_t h = object_hash(key);
+        if (m->kind == O_MAP) h = h * 31 + object_hash(value);
+        hash += h;
+    }
+    return hash;
+}
+
+void map_iter_init(MapIter *it, Object *m)
+{
+    it->depth = 1;
+    it->stack[0].node = m;
+    it->stack[0].i = 0;
+}
+
+bool map_iter_next(MapIter *it, Object **key, Object **value)
+{
+    while (it->depth > 0) {
+        Object *node = it->stack[it->depth - 1].node;
+        size_t i = it->stack[it->depth - 1].i++;
+        if (i == map_node_width(node)) {
+            it->depth--;
+            continue;
+        }
+
+        struct MapEntry entry = node->map.entries[i];
+        if (entry.key == NULL) {
+            assert(it->depth < MAP_MAX_DEPTH);
+            it->stack[it->depth].node = entry.value;
+            it->stack[it->depth].i = 0;
+            it->depth++;
+            continue;
+        }
+        *key = entry.key;
+        *value = entry.value;
+        return true;
+    }
+    return false;
+}
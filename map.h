@@ -0,0 +1,62 @@
+#ifndef MAP_HEADER__
+#define MAP_HEADER__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "object.h"
+
+/* Maps and sets (O_MAP and O_SET) are immutable hash array mapped tries.
+ * Every node is an object of its own: the 5 bits of the key's hash for its
+ * level pick one of 32 entries, the bitmap says which of them are there.
+ * An entry is either a key and its value or, when the key is NULL, a node
+ * one level down. Updating a map copies the path down to the key and
+ * shares the rest with the old one.
+ *
+ * Keys are hashed with object_hash and compared with object_key_equal. Keys
+ * whose hashes are the same all the way down end up in a collision node,
+ * which has no bitmap and just lists them. In a set the value of every key
+ * is the key itself.
+ *
+ * The nodes under the root have the kind of the root, they never show up
+ * as values. Nodes are filled in right after they're made and never
+ * change, so they don't need write barriers. */
+
+#define MAP_BITS 5
+#define MAP_HASH_BITS 64
+/* levels there are room for in the hash, and the collision nodes */
+#define MAP_MAX_DEPTH ((MAP_HASH_BITS + MAP_BITS - 1) / MAP_BITS + 1)
+
+/* number of entries in the node */
+static inline size_t map_node_width(Object *node)
+{
+    if (node->map.bitmap == 0) return node->map.count;
+    return __builtin_popcount(node->map.bitmap);
+}
+
+/* an empty map or set, kind is O_MAP or O_SET */
+Object *map_new(enum ObjectKind kind);
+/* the value of key, NULL if it isn't there */
+Object *map_get(Object *m, Object *key);
+/* these return m itself if nothing changes */
+Object *map_assoc(Object *m, Object *key, Object *value);
+Object *map_dissoc(Object *m, Object *key);
+/* same kind, same keys and equal values. The values are compared with
+ * object_key_equal if keys is set, for maps that are keys themselves */
+bool map_equal(Object *a, Object *b, bool keys);
+/* doesn't depend on the shape of the trie, so equal maps hash the same */
+uint64_t map_hash(Object *m);
+
+/* goes through the entries in no particular order. Nothing can be
+ * evaluated while iterating, the gc doesn't know about the iterator */
+typedef struct {
+    size_t depth;
+    struct {
+        Object *node;
+        size_t i;
+    } stack[MAP_MAX_DEPTH];
+} MapIter;
+void map_iter_init(MapIter *it, Object *m);
+/* false once there are no entries left */
+bool map_iter_next(MapIter *it, Object **key, Object **value);
+
+#endif
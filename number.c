@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "number.h"
+#include "util.h"
+
+_Static_assert(sizeof(long) == sizeof(int64_t), "numbers assume a 64 bit long");
+
+/* the bignum is kept out of line so a number is only two words */
+static inline void _init_big(struct Num *r, mpz_srcptr v)
+{
+    r->is_big = true;
+    r->big = malloc(sizeof(__mpz_struct));
+    CHECK_ALLOC(r->big);
+    mpz_init_set(r->big, v);
+}
+
+static inline void _set_small(struct Num *r, long v)
+{
+    num_clear(r);
+    r->small = v;
+}
+
+mpz_srcptr num_view(const struct Num *a, mpz_t tmp)
+{
+    if (a->is_big) return a->big;
+    mpz_init_set_si(tmp, a->small);
+    return tmp;
+}
+
+void num_view_done(const struct Num *a, mpz_t tmp)
+{
+    if (!a->is_big) mpz_clear(tmp);
+}
+
+void num_init_si(struct Num *r, long v)
+{
+    r->is_big = false;
+    r->small = v;
+}
+
+bool num_init_str(struct Num *r, const char *str)
+{
+    mpz_t v;
+    mpz_init(v);
+    bool ok = mpz_set_str(v, str, 10) == 0;
+    num_init_si(r, 0);
+    num_set_mpz(r, v);
+    mpz_clear(v);
+    return ok;
+}
+
+void num_init_copy(struct Num *r, const struct Num *a)
+{
+    if (a->is_big) _init_big(r, a->big);
+    else num_init_si(r, a->small);
+}
+
+void num_set_mpz(struct Num *r, const mpz_t v)
+{
+    if (mpz_fits_slong_p(v)) {
+        _set_small(r, mpz_get_si(v));
+    } else if (r->is_big) {
+        mpz_set(r->big, v);
+    } else {
+        _init_big(r, v);
+    }
+}
+
+void num_clear(struct Num *n)
+{
+    if (n->is_big) num_free_big(n->big);
+    n->is_big = false;
+}
+
+void num_free_big(void *big)
+{
+    mpz_clear(big);
+    free(big);
+}
+
+/* the slow path of every operation, done with gmp and demoted after */
+static void _big_op(struct Num *r, const struct Num *a, const struct Num *b,
+        void (*op)(mpz_ptr, mpz_srcptr, mpz_srcptr))
+{
+    mpz_t ta, tb, res;
+    mpz_init(res);
+    op(res, num_view(a, ta), num_view(b, tb));
+    num_view_done(a, ta);
+    num_view_done(b, tb);
+    num_set_mpz(r, res);
+    mpz_clear(res);
+}
+
+void num_add(struct Num *r, const struct Num *a, const struct Num *b)
+{
+    long v;
+    if (!a->is_big && !b->is_big && !__builtin_add_overflow(a->small, b->small, &v))
+        _set_small(r, v);
+    else
+        _big_op(r, a, b, mpz_add);
+}
+
+void num_sub(struct Num *r, const struct Num *a, const struct Num *b)
+{
+    long v;
+    if (!a->is_big && !b->is_big && !__builtin_sub_overflow(a->small, b->small, &v))
+        _set_small(r, v);
+    else
+        _big_op(r, a, b, mpz_sub);
+}
+
+void num_mul(struct Num *r, const struct Num *a, const struct Num *b)
+{
+    long v;
+    if (!a->is_big && !b->is_big && !__builtin_mul_overflow(a->small, b->small, &v))
+        _set_small(r, v);
+    else
+        _big_op(r, a, b, mpz_mul);
+}
+
+void num_cdiv_q(struct Num *r, const struct Num *a, const struct Num *b)
+{
+    /* LONG_MIN / -1 is the only quotient of two longs that doesn't fit */
+    if (!a->is_big && !b->is_big && !(a->small == LONG_MIN && b->small == -1)) {
+        long q = a->small / b->small;
+        if (a->small % b->small != 0 && (a->small < 0) == (b->small < 0)) q++;
+        _set_small(r, q);
+    } else {
+        _big_op(r, a, b, mpz_cdiv_q);
+    }
+}
+
+void num_mod(struct Num *r, const struct Num *a, const struct Num *b)
+{
+    if (!a->is_big && !b->is_big) {
+        long m = b->small == -1 ? 0 : a->small % b->small;
+        if (m < 0) m = b->small < 0 ? m - b->small : m + b->small;
+        _set_small(r, m);
+    } else {
+        _big_op(r, a, b, mpz_mod);
+    }
+}
+
+void num_neg(struct Num *r, const struct Num *a)
+{
+    if (!a->is_big && a->small != LONG_MIN) {
+        _set_small(r, -a->small);
+    } else {
+        mpz_t ta, res;
+        mpz_init(res);
+        mpz_neg(res, num_view(a, ta));
+        num_view_done(a, ta);
+        num_set_mpz(r, res);
+        mpz_clear(res);
+    }
+}
+
+int num_cmp(const struct Num *a, const struct Num *b)
+{
+    if (!a->is_big && !b->is_big)
+        return (a->small > b->small) - (a->small < b->small);
+
+    /* a big number is always bigger than any small one */
+    if (!b->is_big) return mpz_sgn(a->big);
+    if (!a->is_big) return -mpz_sgn(b->big);
+    return mpz_cmp(a->big, b->big);
+}
+
+int num_sgn(const struct Num *a)
+{
+    if (a->is_big) return mpz_sgn(a->big);
+    return (a->small > 0) - (a->small < 0);
+}
+
+long num_get_si(const struct Num *a)
+{
+    return a->is_big ? mpz_get_si(a->big) : a->small;
+}
+
+char *num_get_str(const struct Num *a)
+{
+    if (a->is_big) return mpz_get_str(NULL, 10, a->big);
+
+    char *ret = malloc(sizeof(char) * 24);
+    CHECK_ALLOC(ret);
+    snprintf(ret, 24, "%ld", a->small);
+    return ret;
+}
+
+void num_out(FILE *f, const struct Num *a)
+{
+    if (a->is_big) mpz_out_str(f, 10, a->big);
+    else fprintf(f, "%ld", a->small);
+}
@@ -0,0 +1,46 @@
+#ifndef NUMBER_HEADER__
+#define NUMBER_HEADER__
+
+#include <stdio.h>
+#include "object.h"
+
+/* Arithmetic on the numbers in O_NUM objects. Numbers are kept in a long
+ * and checked for overflow, they are only promoted to a gmp bignum when the
+ * result doesn't fit and demoted again when it does. So a number is big if
+ * and only if it doesn't fit in a long.
+ *
+ * The result r may be the same as a or b, like with gmp. It has to be
+ * initialized (any num_init_ function) before it's written to. */
+
+void num_init_si(struct Num *r, long v);
+/* returns false if str isn't a valid base 10 number, r is still initialized */
+bool num_init_str(struct Num *r, const char *str);
+void num_init_copy(struct Num *r, const struct Num *a);
+void num_set_mpz(struct Num *r, const mpz_t v);
+void num_clear(struct Num *n);
+/* frees the bignum of a number that's already gone, like the gc does */
+void num_free_big(void *big);
+
+void num_add(struct Num *r, const struct Num *a, const struct Num *b);
+void num_sub(struct Num *r, const struct Num *a, const struct Num *b);
+void num_mul(struct Num *r, const struct Num *a, const struct Num *b);
+/* rounds towards positive infinity like mpz_cdiv_q, b must not be 0 */
+void num_cdiv_q(struct Num *r, const struct Num *a, const struct Num *b);
+/* always non negative like mpz_mod, b must not be 0 */
+void num_mod(struct Num *r, const struct Num *a, const struct Num *b);
+void num_neg(struct Num *r, const struct Num *a);
+
+int num_cmp(const struct Num *a, const struct Num *b);
+int num_sgn(const struct Num *a);
+/* truncated like mpz_get_si if it doesn't fit */
+long num_get_si(const struct Num *a);
+/* needs to be freed */
+char *num_get_str(const struct Num *a);
+void num_out(FILE *f, const struct Num *a);
+
+/* gives an mpz with the value of a, for when gmp is needed directly.
+ * tmp is used for small numbers, so num_view_done has to be called after */
+mpz_srcptr num_view(const struct Num *a, mpz_t tmp);
+void num_view_done(const struct Num *a, mpz_t tmp);
+
+#endif
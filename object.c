@@ -5,20 +5,177 @@
 #include "util.h"
 #include <sys/param.h>
 #include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
 #include "eval.h"
+#include "compile.h"
+#include "vm.h"
+#include "number.h"
+#include "map.h"
+#include "heap.h"
+#include "environment.h"
+#include "workers.h"
+
+/* Objects and environments start out young, in the nursery. A minor
+ * collection only marks and sweeps the nursery, promoting whatever survives
+ * to the old generation. It never looks inside of old objects, except for
+ * the ones that were written to since (the remembered set, see
+ * GC_write_barrier). Once the old generation has grown GC_GROWTH_FACTOR
+ * times what was live after the last major collection (and is at least
+ * GC_MIN_OLD), a major collection marks and sweeps everything.
+ *
+ * A major collection is spread over the safe points that come after it
+ * starts, one step every GC_STEP_INTERVAL allocations. With a max pause
+ * the marking is done in steps that take about that long, with the write
+ * barrier catching stores into objects that were already marked, and a
+ * last pause to mark what the roots and those stores picked up. Sweeping
+ * is always done a bit at a time, and by the heap when it runs out of
+ * free objects.
+ *
+ * With more than one gc thread (see GC_set_threads) the mark stack is
+ * drained by all of them at once, and the payloads of garbage (arenas,
+ * bignums, code) are freed by a background thread while the sweep goes
+ * on. */
+#define GC_NURSERY_SIZE (1 << 15) /* objects + environments */
+#define GC_MIN_OLD (1 << 16)
+#define GC_GROWTH_FACTOR 2
+#define GC_STEP_INTERVAL (1 << 12)
+/* swept a step when there's no max pause */
+#define GC_SWEEP_STEP_PAGES 16
+#define GC_SWEEP_STEP_ENVS (1 << 14)
+/* gray entries a marking thread keeps to itself before it gives some of
+ * them to the others */
+#define GC_SHARE_BATCH 64
+/* popped frames and swept environments with up to this many slots are
+ * kept to be reused, up to ENV_POOL_MAX of each size. So are the arenas
+ * of their stores, as long as they didn't grow past one chunk */
+#define ENV_POOL_MAX_SLOTS 16
+#define ENV_POOL_MAX (1 << 12)
+#define ENV_ARENA_POOL_MAX 64
+#define ENV_ARENA_SIZE (sizeof(EnvValueStore) * 10)
+/* objects passed to a safe point, see GC_maybe_collect */
+#define GC_MAX_EXTRA_ROOTS 8
+
+typedef enum { GC_IDLE, GC_MARKING, GC_SWEEPING } GCPhase;
+static const char *const gc_phase_string[] = {
+    [GC_IDLE] = "idle",
+    [GC_MARKING] = "marking",
+    [GC_SWEEPING] = "sweeping",
+};
+
+/* upper bounds of the pause histogram's buckets in milliseconds, the last
+ * bucket is for everything longer */
+static const double pause_limits[] = { 0.1, 0.5, 1, 5, 10, 50, 100 };
+#define PAUSE_BUCKETS (sizeof(pause_limits) / sizeof(pause_limits[0]) + 1)
+
+typedef struct { void **ptr; bool is_env; } GCRoot;
+
+/* something on the mark stack */
+typedef enum { GRAY_OBJECT, GRAY_ENV, GRAY_STORE } GrayKind;
+typedef struct { void *ptr; GrayKind kind; } Gray;
+
+typedef struct {
+    size_t len, capacity;
+    Gray *ptr;
+} GrayVec;
+
+/* every thread marks from its own stack, and puts some of its work in a
+ * shared one when that runs empty, for the others to steal */
+typedef struct {
+    GrayVec local;
+    pthread_mutex_t lock;
+    GrayVec shared; /* len is read without the lock */
+} MarkWorker;
+
+typedef struct {
+    size_t len, capacity;
+    Object **ptr;
+} ObjectVec;
+
+typedef struct {
+    size_t len, capacity;
+    Env **ptr;
+} EnvVec;
 
 static struct {
     size_t live_objects;
     size_t live_environments;
-    Object *obj_list;
-    Env *env_list;
+    size_t young; /* objects + environments in the nursery */
+    size_t next_step; /* young objects + environments */
+    size_t next_major; /* size of the old generation */
+    size_t minor_collections, major_collections;
+    GCPhase phase;
+    bool minor; /* if the collection that's running is a minor one */
+    double max_pause; /* ms, 0 if marking isn't incremental */
+    ObjectVec young_objects;
+    Env *env_list; /* young */
+    Env *old_env_list; /* old objects are only found by sweeping the heap */
+    Env *unswept_envs; /* old environments the running sweep hasn't got to */
+    ObjectVec remembered_objects;
+    EnvVec remembered_envs;
+    /* the frame stack, see env_push_frame. Its frames are roots */
+    EnvVec frames;
+    size_t frames_peak, frames_escaped;
+    struct {
+        Env *envs[ENV_POOL_MAX_SLOTS + 1]; /* by slot count, linked with env_next */
+        size_t counts[ENV_POOL_MAX_SLOTS + 1];
+        Arena *arenas[ENV_ARENA_POOL_MAX];
+        size_t arena_count;
+        size_t envs_reused, arenas_reused;
+    } pool;
+    struct { size_t len, capacity; GCRoot *ptr; } roots;
+    GrayVec mark_stack;
+    size_t mark_stack_peak;
+    struct {
+        MarkWorker *ptr;
+        size_t count;
+        size_t idle; /* threads that ran out of work */
+    } mark_workers;
+    struct {
+        size_t count, buckets[PAUSE_BUCKETS];
+        double max, total;
+    } pauses;
 } GC = {
     .live_objects = 0,
     .live_environments = 0,
-    .obj_list= NULL,
+    .young = 0,
+    .next_step = GC_NURSERY_SIZE,
+    .next_major = GC_MIN_OLD,
+    .minor_collections = 0,
+    .major_collections = 0,
+    .phase = GC_IDLE,
+    .minor = false,
+    .max_pause = 0,
+    .young_objects = { 0, 0, NULL },
     .env_list = NULL,
+    .old_env_list = NULL,
+    .unswept_envs = NULL,
+    .remembered_objects = { 0, 0, NULL },
+    .remembered_envs = { 0, 0, NULL },
+    .frames = { 0, 0, NULL },
+    .frames_peak = 0,
+    .frames_escaped = 0,
+    .pool = {
+        .envs = { NULL },
+        .counts = { 0 },
+        .arenas = { NULL },
+        .arena_count = 0,
+        .envs_reused = 0,
+        .arenas_reused = 0,
+    },
+    .roots = { 0, 0, NULL },
+    .mark_stack = { 0, 0, NULL },
+    .mark_stack_peak = 0,
+    .mark_workers = { NULL, 0, 0 },
+    .pauses = { 0 },
 };
 
+bool GC_marking = false;
+/* NULL unless the thread is in _GC_parallel_mark_job. initial-exec keeps
+ * reading it cheap, the library is never dlopen'd */
+static _Thread_local MarkWorker *mark_worker __attribute__((tls_model("initial-exec"))) = NULL;
+
 const char * const object_type_string[] = {
    [O_STR] = "string", 
    [O_NUM] = "number", 
@@ -29,6 +186,13 @@ const char * const object_type_string[] = {
    [O_BUILTIN] = "builtin",
    [O_FUNCTION] = "function",
    [O_CHAR] = "character",
+   [O_VECTOR] = "vector",
+   [O_MAP] = "map",
+   [O_SET] = "set",
+   [O_STRING_BUILDER] = "string-builder",
+   [O_LOCAL] = "local",
+   [O_LAMBDA] = "lambda",
+   [O_LET] = "let",
 };
 
 const char *object_type_as_string(enum ObjectKind k)
@@ -38,14 +202,17 @@ const char *object_type_as_string(enum ObjectKind k)
 
 Object *object_new_generic(void) 
 {
-    Object *ret = malloc(sizeof(Object));
-    CHECK_ALLOC(ret);
+    Object *ret = heap_alloc_object();
     DBG("creating object at %p", ret);
-    ret->eval = true;
-    ret->gc_mark = NOT_MARKED;
-    ret->obj_next = GC.obj_list;
-    GC.obj_list = ret;
+    *ret = (Object) { .kind = O_NIL, .eval = true };
+    if (GC.young_objects.capacity == 0) {
+        GC.young_objects.capacity = 1024;
+        GC.young_objects.ptr = malloc(sizeof(Object *) * GC.young_objects.capacity);
+        CHECK_ALLOC(GC.young_objects.ptr);
+    }
+    da_append(GC.young_objects, ret);
     GC.live_objects++;
+    GC.young++;
     return ret;
 }
 
@@ -61,8 +228,7 @@ Object *object_string_slice_new(const char *s, size_t len)
     if (len == 0) 
         ret->str.ptr = NULL;
     else {
-        ret->str.ptr = malloc(sizeof(char) * len);
-        CHECK_ALLOC(ret->str.ptr);
+        ret->str.ptr = heap_alloc(sizeof(char) * len);
         memcpy(ret->str.ptr, s, len);
     }
 
@@ -85,11 +251,114 @@ char *object_string_slice_to_cstr(Object *str)
     return s;
 }
 
+/* the symbol table. Symbols are never freed, so the identifier objects
+ * inside of them are PERMANENT and never touched by the garbage collector */
+typedef struct Symbol Symbol;
+struct Symbol {
+    Object ident; /* eval = true */
+    Object quoted; /* eval = false */
+    Symbol *next; /* nullable - hash chain */
+    uint64_t hash;
+    char name[]; /* flexible array member */
+};
+
+static struct {
+    Symbol **buckets;
+    size_t len, capacity;
+} symbols = {
+    .buckets = NULL,
+    .len = 0,
+    .capacity = 0,
+};
+
+#define SYMBOLS_DEFAULT_CAPACITY 256
+
+static uint64_t _hash_bytes(const char *s, size_t len)
+{
+    /* FNV-1a */
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline Symbol *_symbol_of(Object *ident)
+{
+    assert(ident->kind == O_IDENT);
+    return (Symbol *)(ident->str.ptr - offsetof(Symbol, name));
+}
+
+static void _symbols_grow(void)
+{
+    size_t new_capacity = symbols.capacity ? symbols.capacity * 2 : SYMBOLS_DEFAULT_CAPACITY;
+    Symbol **new_buckets = calloc(new_capacity, sizeof(Symbol *));
+    CHECK_ALLOC(new_buckets);
+
+    for (size_t i = 0; i < symbols.capacity; i++) {
+        Symbol *sym = symbols.buckets[i];
+        while (sym) {
+            Symbol *next = sym->next;
+            size_t index = sym->hash & (new_capacity - 1);
+            sym->next = new_buckets[index];
+            new_buckets[index] = sym;
+            sym = next;
+        }
+    }
+
+    free(symbols.buckets);
+    symbols.buckets = new_buckets;
+    symbols.capacity = new_capacity;
+}
+
 Object *object_ident_new(const char *s, size_t len)
 {
-    Object *ret = object_string_slice_new(s, len);
-    ret->kind = O_IDENT;
-    return ret;
+    uint64_t hash = _hash_bytes(s, len);
+    if (symbols.capacity) {
+        Symbol *sym = symbols.buckets[hash & (symbols.capacity - 1)];
+        for (; sym; sym = sym->next) {
+            if (sym->hash == hash && sym->ident.str.len == len && memcmp(sym->name, s, len) == 0)
+                return &sym->ident;
+        }
+    }
+
+    /* keep the load factor under 3/4 */
+    if ((symbols.len + 1) * 4 > symbols.capacity * 3) _symbols_grow();
+
+    /* the plus one is so empty identifiers still get a unique name ptr */
+    Symbol *sym = malloc(sizeof(Symbol) + sizeof(char) * (len + 1));
+    CHECK_ALLOC(sym);
+    memcpy(sym->name, s, len);
+    sym->name[len] = '\0';
+    sym->hash = hash;
+
+    sym->ident = (Object) {
+        .permanent = true,
+        .kind = O_IDENT,
+        .eval = true,
+        .str = { .ptr = sym->name, .len = len, .capacity = len },
+    };
+    sym->quoted = sym->ident;
+    sym->quoted.eval = false;
+
+    size_t index = hash & (symbols.capacity - 1);
+    sym->next = symbols.buckets[index];
+    symbols.buckets[index] = sym;
+    symbols.len++;
+
+    return &sym->ident;
+}
+
+Object *object_ident_with_eval(Object *ident, bool eval)
+{
+    Symbol *sym = _symbol_of(ident);
+    return eval ? &sym->ident : &sym->quoted;
+}
+
+uint64_t object_ident_hash(Object *ident)
+{
+    return _symbol_of(ident)->hash;
 }
 
 Object *object_ident_new_cstr(const char *s)
@@ -114,24 +383,124 @@ Object *object_builtin_new(Builtin f)
     Object *ret = object_new_generic();
     ret->kind = O_BUILTIN;
     ret->builtin = f;
+    ret->prim = NULL;
+    return ret;
+}
+
+Object *object_primitive_new(const PrimitiveDef *def)
+{
+    Object *ret = object_new_generic();
+    ret->kind = O_BUILTIN;
+    ret->builtin = NULL;
+    ret->prim = def;
     return ret;
 }
 
+/* nil, characters and small numbers are shared like identifiers. There is
+ * one PERMANENT object for every value (and a quoted one), so making them
+ * never allocates and the gc never sees them */
+#define SHARED_NUM_MIN (-128)
+#define SHARED_NUM_MAX 1023
+
+static struct {
+    bool initialized;
+    /* indexed by eval first */
+    Object nil[2];
+    Object chars[2][256];
+    Object nums[2][SHARED_NUM_MAX - SHARED_NUM_MIN + 1];
+} shared = { .initialized = false };
+
+static void _shared_init(void)
+{
+    for (int eval = 0; eval < 2; eval++) {
+        shared.nil[eval] = (Object) {
+            .permanent = true,
+            .kind = O_NIL,
+            .eval = eval,
+        };
+
+        for (int c = 0; c < 256; c++) {
+            shared.chars[eval][c] = (Object) {
+                .permanent = true,
+                .kind = O_CHAR,
+                .eval = eval,
+                .character = (char)c,
+            };
+        }
+
+        for (long n = SHARED_NUM_MIN; n <= SHARED_NUM_MAX; n++) {
+            Object *o = &shared.nums[eval][n - SHARED_NUM_MIN];
+            *o = (Object) {
+                .permanent = true,
+                .kind = O_NUM,
+                .eval = eval,
+            };
+            num_init_si(&o->num, n);
+        }
+    }
+    shared.initialized = true;
+}
+
+static inline bool _num_is_shared(const struct Num *n)
+{
+    return !n->is_big && n->small >= SHARED_NUM_MIN && n->small <= SHARED_NUM_MAX;
+}
+
 Object *object_num_new(int64_t num)
 {
+    if (num >= SHARED_NUM_MIN && num <= SHARED_NUM_MAX) {
+        if (!shared.initialized) _shared_init();
+        return &shared.nums[true][num - SHARED_NUM_MIN];
+    }
+
     Object *ret = object_new_generic();
     ret->kind = O_NUM;
-    mpz_init(ret->num);
-    _Static_assert(sizeof(int64_t) == sizeof(signed long int), "");
-    mpz_set_si(ret->num, num);
+    num_init_si(&ret->num, num);
     return ret;
 }
 
-Object *object_num_new_token(Token *t)
+Object *object_num_new_num(struct Num *n)
 {
+    if (_num_is_shared(n)) return object_num_new(n->small);
+
     Object *ret = object_new_generic();
     ret->kind = O_NUM;
-        
+    ret->num = *n;
+    return ret;
+}
+
+Object *object_num_new_mutable(int64_t num)
+{
+    Object *ret = object_new_generic();
+    ret->kind = O_NUM;
+    num_init_si(&ret->num, num);
+    return ret;
+}
+
+Object *object_with_eval(Object *o, bool eval)
+{
+    if (!o->permanent) {
+        o->eval = eval;
+        return o;
+    }
+
+    switch (o->kind) {
+        case O_IDENT:
+            return object_ident_with_eval(o, eval);
+        case O_NIL:
+            return &shared.nil[eval];
+        case O_CHAR:
+            return &shared.chars[eval][(unsigned char)o->character];
+        case O_NUM:
+            return &shared.nums[eval][o->num.small - SHARED_NUM_MIN];
+        default:
+            assert(0 && "only identifiers and shared values are permanent");
+    }
+    return o;
+}
+
+Object *object_num_new_token(Token *t)
+{
     assert(t->type == t_NUM);
     char *str = malloc(sizeof(char) * (t->string_slice.len + 1));
     CHECK_ALLOC(str);
@@ -139,18 +508,17 @@ Object *object_num_new_token(Token *t)
     memcpy(str, t->string_slice.ptr, t->string_slice.len);
     str[t->string_slice.len] = '\0';
 
-    mpz_init(ret->num);
-    mpz_set_str(ret->num, str, 10);
+    struct Num n;
+    num_init_str(&n, str);
     free(str);
 
-    return ret;
+    return object_num_new_num(&n);
 }
 
 Object *object_nil_new(void)
 {
-    Object *ret = object_new_generic();
-    ret->kind = O_NIL;
-    return ret;
+    if (!shared.initialized) _shared_init();
+    return &shared.nil[true];
 }
 
 // helper function for object_error_new()
@@ -200,7 +568,7 @@ Object *object_error_new(const char *fmt, ...)
                 case 'd': {
                     Object *num = va_arg(ap, Object *);
                     assert(num->kind == O_NUM);
-                    char *num_cstr = mpz_get_str(NULL, 10, num->num);
+                    char *num_cstr = num_get_str(&num->num);
                     size_t len = strlen(num_cstr);
 
                     _copy_slice_to_ss(&ret->str, num_cstr, len);
@@ -218,9 +586,12 @@ Object *object_error_new(const char *fmt, ...)
         }
     }
 
+    /* the message is built up in a malloc'd buffer and moved to the heap */
+    char *message = ret->str.ptr;
     ret->str.capacity = ret->str.len;
-    ret->str.ptr = realloc(ret->str.ptr, sizeof(char) * ret->str.capacity);
-    CHECK_ALLOC(ret->str.ptr);
+    ret->str.ptr = heap_alloc(sizeof(char) * ret->str.capacity);
+    memcpy(ret->str.ptr, message, ret->str.len);
+    free(message);
 
     va_end(ap);
 
@@ -234,80 +605,291 @@ Object *object_error_new_from_string_slice(Object *o)
     Object *ret = object_new_generic();
     ret->kind = O_ERROR;
     ret->str.capacity = ret->str.len = o->str.len;
-    ret->str.ptr = malloc(sizeof(char) * ret->str.capacity);
-    CHECK_ALLOC(ret->str.ptr);
+    ret->str.ptr = heap_alloc(sizeof(char) * ret->str.capacity);
     memcpy(ret->str.ptr, o->str.ptr, ret->str.len);
 
     report_error(ret);
     return ret;
 }
 
-Object *object_function_new(Env *e, Object *args, Object *body)
+Object *object_function_new(Env *e, Object *lambda)
 {
+    assert(lambda->kind == O_LAMBDA);
+    if (lambda->lambda->flat) e = env_new_closure(e, lambda);
+    else env_escape(e);
     Object *ret = object_new_generic();
     ret->kind = O_FUNCTION;
-    ret->function.arguments = args;
-    ret->function.body = body;
+    ret->function.lambda = lambda;
     ret->function.env = e;
     return ret;
 }
 
 Object *object_char_new(char c)
+{
+    if (!shared.initialized) _shared_init();
+    return &shared.chars[true][(unsigned char)c];
+}
+
+Object *object_vector_new(size_t capacity)
+{
+    assert(capacity <= UINT32_MAX);
+    Object *ret = object_new_generic();
+    ret->kind = O_VECTOR;
+    ret->vector.len = 0;
+    ret->vector.capacity = (uint32_t)capacity;
+    ret->vector.items = heap_alloc(sizeof(Object *) * capacity);
+    return ret;
+}
+
+void object_vector_push(Object *v, Object *value)
+{
+    assert(v->kind == O_VECTOR);
+    if (v->vector.len == v->vector.capacity) {
+        size_t capacity = v->vector.capacity ? (size_t)v->vector.capacity * 2 : 4;
+        if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+        CHECK_ALLOC(capacity > v->vector.len);
+        v->vector.items = heap_realloc(v->vector.items, sizeof(Object *) * v->vector.capacity,
+                sizeof(Object *) * capacity);
+        v->vector.capacity = (uint32_t)capacity;
+    }
+    v->vector.items[v->vector.len++] = value;
+    GC_write_barrier(v);
+}
+
+/* with keys set, vectors and string builders are only equal to themselves */
+static bool _object_equal(Object *a, Object *b, bool keys)
+{
+    /* lists are compared in a loop so long ones don't use up the stack */
+    while (a != b) {
+        if (a->kind != b->kind) return false;
+        switch (a->kind) {
+            case O_NUM:
+                return num_cmp(&a->num, &b->num) == 0;
+            case O_IDENT:
+                return IDENT_EQ(a, b);
+            case O_STRING_BUILDER:
+                if (keys) return false;
+                /* fallthrough */
+            case O_STR: case O_ERROR:
+                return a->str.len == b->str.len && memcmp(a->str.ptr, b->str.ptr, a->str.len) == 0;
+            case O_NIL:
+                return true;
+            case O_CHAR:
+                return a->character == b->character;
+            case O_LIST:
+                if (!_object_equal(a->list.car, b->list.car, keys)) return false;
+                a = a->list.cdr;
+                b = b->list.cdr;
+                break;
+            case O_VECTOR:
+                if (keys || a->vector.len != b->vector.len) return false;
+                for (uint32_t i = 0; i < a->vector.len; i++) {
+                    if (!object_equal(a->vector.items[i], b->vector.items[i])) return false;
+                }
+                return true;
+            case O_MAP: case O_SET:
+                return map_equal(a, b, keys);
+            /* functions are only equal to themselves */
+            case O_BUILTIN:
+                return a->builtin == b->builtin && a->prim == b->prim;
+            case O_FUNCTION:
+                return a->function.lambda == b->function.lambda && a->function.env == b->function.env;
+            case O_LAMBDA:
+                return false;
+            case O_LOCAL: case O_LET:
+                assert(0 && "resolver objects are never values");
+                return false;
+        }
+    }
+    return true;
+}
+
+bool object_equal(Object *a, Object *b)
+{
+    return _object_equal(a, b, false);
+}
+
+bool object_key_equal(Object *a, Object *b)
+{
+    return _object_equal(a, b, true);
+}
+
+/* the finalizer of splitmix64, so numbers that are close together don't
+ * end up in the same branch of a map */
+static inline uint64_t _hash_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t object_hash(Object *o)
+{
+    uint64_t hash = o->kind;
+    for (;;) {
+        switch (o->kind) {
+            case O_NUM:
+                if (!o->num.is_big) return _hash_mix(hash ^ (uint64_t)o->num.small);
+                /* big numbers never fit in a long, so they can't be equal to
+                 * a small one. Their limbs are hashed like a string */
+                return _hash_mix(hash ^ _hash_bytes((const char *)mpz_limbs_read(o->num.big),
+                            sizeof(mp_limb_t) * mpz_size(o->num.big)) ^ (mpz_sgn(o->num.big) < 0));
+            case O_IDENT:
+                return object_ident_hash(o);
+            case O_STR: case O_ERROR:
+                return hash ^ _hash_bytes(o->str.ptr, o->str.len);
+            case O_NIL:
+                return _hash_mix(hash);
+            case O_CHAR:
+                return _hash_mix(hash ^ ((uint64_t)(unsigned char)o->character << 8));
+            case O_LIST:
+                hash = (hash ^ object_hash(o->list.car)) * 1099511628211ULL;
+                o = o->list.cdr;
+                break;
+            /* these can change after they're hashed, so they're hashed by
+             * where they are, see object_key_equal */
+            case O_VECTOR: case O_STRING_BUILDER:
+                return _hash_mix((uintptr_t)o);
+            case O_MAP: case O_SET:
+                return _hash_mix(map_hash(o));
+            case O_BUILTIN:
+                return _hash_mix((uintptr_t)o->builtin ^ (uintptr_t)o->prim);
+            case O_FUNCTION:
+                return _hash_mix((uintptr_t)o->function.lambda ^ (uintptr_t)o->function.env);
+            case O_LAMBDA: case O_LOCAL: case O_LET:
+                return _hash_mix((uintptr_t)o);
+        }
+    }
+}
+
+Object *object_string_builder_new(void)
 {
     Object *ret = object_new_generic();
-    ret->kind = O_CHAR;
-    ret->character = c;
+    ret->kind = O_STRING_BUILDER;
+    ret->str = (struct StringSlice) { .ptr = NULL, .len = 0, .capacity = 0 };
     return ret;
 }
 
+void object_string_builder_append(Object *b, const char *s, size_t len)
+{
+    assert(b->kind == O_STRING_BUILDER);
+    assert(len <= UINT32_MAX - b->str.len);
+    if (len == 0) return;
+    if (b->str.len + len > b->str.capacity) {
+        /* doubling keeps appending amortised O(1) */
+        size_t capacity = b->str.capacity ? (size_t)b->str.capacity * 2 : 32;
+        if (capacity < b->str.len + len) capacity = b->str.len + len;
+        if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+        b->str.ptr = heap_realloc(b->str.ptr, b->str.capacity, capacity);
+        b->str.capacity = (uint32_t)capacity;
+    }
+    memcpy(b->str.ptr + b->str.len, s, len);
+    b->str.len += len;
+}
+
 Object *object_shallow_copy(Object *o)
 {
+    /* identifiers are interned, so the only copy of one is itself. The
+     * resolver's objects are immutable so they don't need copying either */
+    if (o->kind == O_IDENT || o->kind == O_LOCAL || o->kind == O_LAMBDA || o->kind == O_LET) 
+        return o;
+
     Object *ret = object_new_generic();
     ret->kind = o->kind;
     ret->eval = o->eval;
 
     switch (o->kind) {
         case O_NUM: {
-            mpz_init(ret->num);
-            mpz_set(ret->num, o->num);
+            num_init_copy(&ret->num, &o->num);
         } break;
-        case O_STR: case O_IDENT: case O_ERROR: {
+        case O_STR: case O_ERROR: case O_STRING_BUILDER: {
             ret->str.len = ret->str.capacity = o->str.len;
-            ret->str.ptr = malloc(sizeof(char) * ret->str.capacity);
-            CHECK_ALLOC(ret->str.ptr);
+            ret->str.ptr = heap_alloc(sizeof(char) * ret->str.capacity);
             memcpy(ret->str.ptr, o->str.ptr, ret->str.len);
         } break;
         case O_LIST: {
             ret->list.car = o->list.car;
             ret->list.cdr = o->list.cdr;
         } break;
-        case O_NIL: break;
+        case O_NIL: case O_IDENT: case O_LOCAL: case O_LAMBDA: case O_LET: break;
         case O_BUILTIN: {
             ret->builtin = o->builtin;
+            ret->prim = o->prim;
         } break;
         case O_CHAR: {
             ret->character = o->character;
         } break;
         case O_FUNCTION: {
-            ret->function.arguments = o->function.arguments;
-            ret->function.body = o->function.body;
+            ret->function.lambda = o->function.lambda;
             ret->function.env = o->function.env;
         } break;
+        case O_VECTOR: {
+            /* the copy gets items of its own, they are freed with it */
+            ret->vector.len = ret->vector.capacity = o->vector.len;
+            ret->vector.items = heap_alloc(sizeof(Object *) * ret->vector.capacity);
+            if (o->vector.len) memcpy(ret->vector.items, o->vector.items, sizeof(Object *) * o->vector.len);
+        } break;
+        case O_MAP: case O_SET: {
+            /* the nodes under the root are shared, they never change */
+            size_t width = map_node_width(o);
+            ret->map = o->map;
+            ret->map.entries = heap_alloc(sizeof(struct MapEntry) * width);
+            if (width) memcpy(ret->map.entries, o->map.entries, sizeof(struct MapEntry) * width);
+        } break;
     }
 
     return ret;
 }
 
-void object_free(Object *o)
+static void _lambda_free(void *p)
+{
+    struct Lambda *lambda = p;
+    if (lambda->code) code_free(lambda->code);
+    free(lambda->captures);
+    free(lambda->capture_names);
+    free(lambda);
+}
+
+static void _let_free(void *p)
+{
+    struct Let *let = p;
+    free(let->binding_slots);
+    free(let->binding_values);
+    free(let);
+}
+
+/* what's malloc'd can be freed in the background, string bodies are in
+ * the heap so they can't */
+static void _object_free_payload(Object *o)
 {
     DBG("freeing object at %p", o);
-    if (o->kind == O_STR || o->kind == O_IDENT || o->kind == O_ERROR) 
-        free(o->str.ptr);
+    assert(!o->permanent);
+    if (o->kind == O_STR || o->kind == O_ERROR || o->kind == O_STRING_BUILDER)
+        heap_free(o->str.ptr, o->str.capacity);
+
+    if (o->kind == O_VECTOR)
+        heap_free(o->vector.items, sizeof(Object *) * o->vector.capacity);
+
+    if (o->kind == O_MAP || o->kind == O_SET)
+        heap_free(o->map.entries, sizeof(struct MapEntry) * map_node_width(o));
 
-    if (o->kind == O_NUM) 
-        mpz_clear(o->num);
+    if (o->kind == O_NUM && o->num.is_big) 
+        workers_defer_free(num_free_big, o->num.big);
 
-    free(o);
+    if (o->kind == O_LAMBDA)
+        workers_defer_free(_lambda_free, o->lambda);
+
+    if (o->kind == O_LET)
+        workers_defer_free(_let_free, o->let);
+}
+
+void object_free(Object *o)
+{
+    _object_free_payload(o);
+    heap_free_object(o);
 }
 
 inline static void _print_slice(struct StringSlice str)
@@ -320,13 +902,13 @@ void object_print(Object *o)
 {
     assert(o);
     switch (o->kind) {
-        case O_STR:
+        case O_STR: case O_STRING_BUILDER:
             putchar('"');
             _print_slice(o->str);
             putchar('"');
             break;
         case O_NUM: {
-            mpz_out_str(stdout, 10, o->num);
+            num_out(stdout, &o->num);
         } break;
         case O_IDENT:
             _print_slice(o->str);
@@ -352,38 +934,280 @@ void object_print(Object *o)
             _print_slice(o->str);
             break;
         case O_BUILTIN:
-            printf("builtin <%p>", o->builtin);
+            if (o->prim) printf("builtin <%s>", o->prim->name);
+            else printf("builtin <%p>", o->builtin);
             break;
         case O_FUNCTION:
-            object_print(o->function.arguments);
-            printf(" -> ");
-            object_print(o->function.body);
+            object_print(o->function.lambda);
             break;
         case O_CHAR:
             printf("~%c", o->character);
             break;
+        case O_VECTOR:
+            printf("#(");
+            for (uint32_t i = 0; i < o->vector.len; i++) {
+                if (i > 0) putchar(' ');
+                object_print(o->vector.items[i]);
+            }
+            printf(")");
+            break;
+        case O_MAP: case O_SET: {
+            printf(o->kind == O_MAP ? "{" : "#{");
+            MapIter it;
+            map_iter_init(&it, o);
+            Object *key, *value;
+            for (bool first = true; map_iter_next(&it, &key, &value); first = false) {
+                if (!first) putchar(' ');
+                object_print(key);
+                if (o->kind == O_MAP) {
+                    putchar(' ');
+                    object_print(value);
+                }
+            }
+            printf("}");
+        } break;
+        case O_LOCAL:
+            object_print(o->local.ident);
+            break;
+        case O_LAMBDA:
+            object_print(o->lambda->arguments);
+            printf(" -> ");
+            object_print(o->lambda->body);
+            break;
+        case O_LET:
+            printf("let <%p>", o->let);
+            break;
     }
 }
 
-Env *env_new(Env *parent)
+static void _GC_env_free(void *e)
+{
+    env_free(e);
+}
+
+static void _GC_arena_free(void *a)
+{
+    arena_destroy(a);
+}
+
+static Env *_env_alloc(size_t slot_count)
 {
-    Arena *a = arena_new(sizeof(EnvValueStore) * 10 + sizeof(Env));
-    Env *ret = arena_alloc(a, sizeof(Env));
+    if (slot_count <= ENV_POOL_MAX_SLOTS && GC.pool.envs[slot_count]) {
+        Env *ret = GC.pool.envs[slot_count];
+        GC.pool.envs[slot_count] = ret->env_next;
+        GC.pool.counts[slot_count]--;
+        GC.pool.envs_reused++;
+        return ret;
+    }
+
+    Env *ret = malloc(sizeof(Env) + sizeof(Object *) * slot_count);
     CHECK_ALLOC(ret);
+    return ret;
+}
+
+/* puts e back in the pool, or frees it in the background if the pool is
+ * full. Only the main thread touches the pool */
+static void _env_recycle(Env *e)
+{
+    if (e->table) {
+        /* the bindings go with it, so caches pointing to them are stale */
+        workers_defer_free(free, e->table);
+        env_version++;
+    }
+    e->table = NULL;
+    Arena *a = e->arena;
+    e->arena = NULL;
+    if (a && GC.pool.arena_count < ENV_ARENA_POOL_MAX && a->first->next == NULL) {
+        arena_clear(a);
+        GC.pool.arenas[GC.pool.arena_count++] = a;
+    } else if (a) {
+        workers_defer_free(_GC_arena_free, a);
+    }
+
+    size_t slot_count = e->slot_count;
+    if (slot_count <= ENV_POOL_MAX_SLOTS && GC.pool.counts[slot_count] < ENV_POOL_MAX) {
+        e->env_next = GC.pool.envs[slot_count];
+        GC.pool.envs[slot_count] = e;
+        GC.pool.counts[slot_count]++;
+    } else {
+        workers_defer_free(_GC_env_free, e);
+    }
+}
+
+Arena *env_arena(Env *e)
+{
+    if (e->arena) return e->arena;
+    if (GC.pool.arena_count > 0) {
+        e->arena = GC.pool.arenas[--GC.pool.arena_count];
+        GC.pool.arenas_reused++;
+    } else {
+        e->arena = arena_new(ENV_ARENA_SIZE);
+    }
+    return e->arena;
+}
+
+static Env *_env_new(Env *parent, Object *scope, size_t slot_count, Object **slot_names)
+{
+    Env *ret = _env_alloc(slot_count);
     *ret = (Env) {
         .parent = parent,
         .store = NULL,
+        .table = NULL,
         .env_next = GC.env_list,
         .gc_mark = NOT_MARKED,
-        .arena = a,
+        .old = false,
+        .remembered = false,
+        .on_stack = false,
+        .escaped = false,
+        .arena = NULL,
+        .scope = scope,
+        .slot_count = slot_count,
+        .slot_names = slot_names,
     };
+    for (size_t i = 0; i < slot_count; i++)
+        ret->slots[i] = NULL;
+
     GC.env_list = ret;
     GC.live_environments++;
+    GC.young++;
 
     return ret;
 }
 
-static void _GC_mark_env(Env *e);
+Env *env_new(Env *parent)
+{
+    return _env_new(parent, NULL, 0, NULL);
+}
+
+Env *env_push_frame(Env *parent, Object *scope)
+{
+    size_t slot_count;
+    Object **slot_names;
+    if (scope->kind == O_LAMBDA) {
+        slot_count = scope->lambda->slot_count;
+        slot_names = scope->lambda->names;
+    } else {
+        assert(scope->kind == O_LET);
+        slot_count = scope->let->slot_count;
+        slot_names = scope->let->names;
+    }
+
+    Env *ret = _env_alloc(slot_count);
+    *ret = (Env) {
+        .parent = parent,
+        .store = NULL,
+        .table = NULL,
+        .env_next = NULL,
+        .gc_mark = NOT_MARKED,
+        .old = false,
+        .remembered = false,
+        .on_stack = true,
+        .escaped = false,
+        .arena = NULL,
+        .scope = scope,
+        .slot_count = slot_count,
+        .slot_names = slot_names,
+    };
+    for (size_t i = 0; i < slot_count; i++)
+        ret->slots[i] = NULL;
+
+    if (GC.frames.capacity == 0) {
+        GC.frames.capacity = 256;
+        GC.frames.ptr = malloc(sizeof(Env *) * GC.frames.capacity);
+        CHECK_ALLOC(GC.frames.ptr);
+    }
+    da_append(GC.frames, ret);
+    if (GC.frames.len > GC.frames_peak) GC.frames_peak = GC.frames.len;
+    return ret;
+}
+
+size_t env_frame_count(void)
+{
+    return GC.frames.len;
+}
+
+/* an escaped frame becomes an old environment, the frames it points to
+ * escaped too so they'll follow. It's remembered because it might point
+ * to young objects, and during marking it's only marked if it's scanned */
+static void _GC_adopt_frame(Env *e)
+{
+    e->on_stack = false;
+    e->old = true;
+    e->gc_mark = GC.phase == GC_MARKING ? MARKED : NOT_MARKED;
+    e->env_next = GC.old_env_list;
+    GC.old_env_list = e;
+    GC.live_environments++;
+    GC.frames_escaped++;
+    if (!e->remembered) GC_remember_env(e);
+}
+
+void env_pop_frames(size_t count)
+{
+    assert(count <= GC.frames.len);
+    while (GC.frames.len > count) {
+        Env *e = GC.frames.ptr[--GC.frames.len];
+        /* the gc might still get to a frame that's remembered, or marked
+         * while an incremental collection is going on, so it has to stay */
+        if (e->escaped || e->remembered || e->gc_mark == MARKED) {
+            _GC_adopt_frame(e);
+            continue;
+        }
+
+        _env_recycle(e);
+    }
+}
+
+void env_escape(Env *e)
+{
+    /* the frames under an escaped one escaped already */
+    for (; e && e->on_stack && !e->escaped; e = e->parent)
+        e->escaped = true;
+}
+
+Env *env_new_closure(Env *e, Object *lambda)
+{
+    struct Lambda *l = lambda->lambda;
+    Env *globals = e;
+    while (globals && globals->scope) globals = globals->parent;
+    if (l->capture_count == 0) return globals;
+
+    Env *ret = _env_new(globals, lambda, l->capture_count, l->capture_names);
+    for (size_t i = 0; i < l->capture_count; i++)
+        ret->slots[i] = env_get_local(e, l->captures[i].depth, l->captures[i].slot, l->capture_names[i]);
+    return ret;
+}
+
+/* marking doesn't recurse, whatever is marked but not scanned yet is
+ * pushed on the mark stack and scanned by _GC_drain_mark_stack. Lists are
+ * scanned along their cdrs without pushing the spine */
+static void _GC_gray_vec_append(GrayVec *vec, Gray gray)
+{
+    if (vec->capacity == 0) {
+        vec->capacity = 256;
+        vec->ptr = malloc(sizeof(Gray) * vec->capacity);
+        CHECK_ALLOC(vec->ptr);
+    }
+    da_append(*vec, gray);
+}
+
+static void _GC_push_gray(void *ptr, GrayKind kind)
+{
+    Gray gray = { .ptr = ptr, .kind = kind };
+    if (mark_worker) {
+        _GC_gray_vec_append(&mark_worker->local, gray);
+        return;
+    }
+    _GC_gray_vec_append(&GC.mark_stack, gray);
+    if (GC.mark_stack.len > GC.mark_stack_peak) GC.mark_stack_peak = GC.mark_stack.len;
+}
+
+/* marks o, returns false if it already was. During a minor collection
+ * old objects count as marked */
+static inline bool _GC_try_mark(Object *o)
+{
+    if (o->permanent || (GC.minor && o->old)) return false;
+    return mark_worker ? !heap_mark_atomic(o) : !heap_mark(o);
+}
 
 static void _GC_mark_object(Object *o)
 {
@@ -391,19 +1215,66 @@ static void _GC_mark_object(Object *o)
         DBG("_GC_mark tried to mark a null object");
         return;
     }
-    if (o->gc_mark == MARKED) { return; }
-    o->gc_mark = MARKED;
+    if (!_GC_try_mark(o)) return;
+    /* numbers, strings and the like have nothing to scan */
+    if (o->kind == O_LIST || o->kind == O_FUNCTION || o->kind == O_LAMBDA || o->kind == O_LET
+            || o->kind == O_VECTOR || o->kind == O_MAP || o->kind == O_SET)
+        _GC_push_gray(o, GRAY_OBJECT);
+}
 
-    if (o->kind == O_LIST) {
+static void _GC_mark_env(Env *e) 
+{
+    if (GC.minor && e->old) return;
+    if (mark_worker) {
+        if (__atomic_exchange_n(&e->gc_mark, MARKED, __ATOMIC_RELAXED) == MARKED) return;
+    } else {
+        if (e->gc_mark == MARKED) return;
+        e->gc_mark = MARKED;
+    }
+    _GC_push_gray(e, GRAY_ENV);
+}
+
+static void _GC_mark_object_children(Object *o)
+{
+    while (o->kind == O_LIST) {
         _GC_mark_object(o->list.car);
-        _GC_mark_object(o->list.cdr);
+        o = o->list.cdr;
+        if (!_GC_try_mark(o)) return;
     }
 
     if (o->kind == O_FUNCTION) {
-        _GC_mark_object(o->function.arguments);
-        _GC_mark_object(o->function.body);
+        _GC_mark_object(o->function.lambda);
         _GC_mark_env(o->function.env);
     }
+
+    if (o->kind == O_LAMBDA) {
+        _GC_mark_object(o->lambda->arguments);
+        _GC_mark_object(o->lambda->body);
+        _GC_mark_object(o->lambda->resolved);
+        if (o->lambda->code) {
+            for (size_t i = 0; i < o->lambda->code->constant_count; i++)
+                _GC_mark_object(o->lambda->code->constants[i]);
+        }
+    }
+
+    if (o->kind == O_VECTOR) {
+        for (uint32_t i = 0; i < o->vector.len; i++)
+            _GC_mark_object(o->vector.items[i]);
+    }
+
+    if (o->kind == O_MAP || o->kind == O_SET) {
+        for (size_t i = 0; i < map_node_width(o); i++) {
+            struct MapEntry *entry = &o->map.entries[i];
+            if (entry->key) _GC_mark_object(entry->key);
+            _GC_mark_object(entry->value);
+        }
+    }
+
+    if (o->kind == O_LET) {
+        for (size_t i = 0; i < o->let->binding_count; i++)
+            _GC_mark_object(o->let->binding_values[i]);
+        _GC_mark_object(o->let->resolved);
+    }
 }
 
 static void _GC_mark_evstore(EnvValueStore *evs) 
@@ -411,72 +1282,543 @@ static void _GC_mark_evstore(EnvValueStore *evs)
     _GC_mark_object(evs->ident);
     _GC_mark_object(evs->value);
 
-    if (evs->left) _GC_mark_evstore(evs->left);
-    if (evs->right) _GC_mark_evstore(evs->right);
+    if (evs->left) _GC_push_gray(evs->left, GRAY_STORE);
+    if (evs->right) _GC_push_gray(evs->right, GRAY_STORE);
 }
 
-static void _GC_mark_env(Env *e) 
+static void _GC_mark_env_children(Env *e)
 {
-    if (e->gc_mark == MARKED) return;
-    e->gc_mark = MARKED;
     // mark items in the envstores
-    if (e->store) _GC_mark_evstore(e->store);
+    if (e->store) _GC_push_gray(e->store, GRAY_STORE);
+    if (e->table) {
+        for (size_t i = 0; i < e->table->capacity; i++) {
+            EnvBinding *b = e->table->buckets[i];
+            if (b == NULL) continue;
+            _GC_mark_object(b->ident);
+            _GC_mark_object(b->value);
+        }
+    }
+    if (e->scope) _GC_mark_object(e->scope);
+    for (size_t i = 0; i < e->slot_count; i++)
+        if (e->slots[i]) _GC_mark_object(e->slots[i]);
 
     if (e->parent) _GC_mark_env(e->parent);
 }
 
-static void _GC_sweep(void)
+static double _GC_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static void _GC_scan_gray(Gray gray)
+{
+    switch (gray.kind) {
+        case GRAY_OBJECT: _GC_mark_object_children(gray.ptr); break;
+        case GRAY_ENV: _GC_mark_env_children(gray.ptr); break;
+        case GRAY_STORE: _GC_mark_evstore(gray.ptr); break;
+    }
+}
+
+/* returns true once the stack is empty, or false if the deadline (in ms,
+ * 0 for none) passed first */
+static bool _GC_drain_mark_stack_until(double deadline)
+{
+    size_t scanned = 0;
+    while (GC.mark_stack.len > 0) {
+        _GC_scan_gray(GC.mark_stack.ptr[--GC.mark_stack.len]);
+        if (deadline && ++scanned % 256 == 0 && _GC_now() >= deadline) 
+            return GC.mark_stack.len == 0;
+    }
+    return true;
+}
+
+/* moves the top GC_SHARE_BATCH entries of w's stack to its shared one */
+static void _GC_share_grays(MarkWorker *w)
+{
+    w->local.len -= GC_SHARE_BATCH;
+    pthread_mutex_lock(&w->lock);
+    size_t len = w->shared.len;
+    if (w->shared.capacity < len + GC_SHARE_BATCH) {
+        w->shared.capacity = MAX(256, 2 * (len + GC_SHARE_BATCH));
+        w->shared.ptr = realloc(w->shared.ptr, sizeof(Gray) * w->shared.capacity);
+        CHECK_ALLOC(w->shared.ptr);
+    }
+    memcpy(w->shared.ptr + len, w->local.ptr + w->local.len, sizeof(Gray) * GC_SHARE_BATCH);
+    __atomic_store_n(&w->shared.len, len + GC_SHARE_BATCH, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* takes half of the first shared stack that isn't empty, starting with
+ * w's own. So a thread has taken all of its shared work back before it
+ * runs out */
+static bool _GC_steal_grays(MarkWorker *w, size_t id)
+{
+    for (size_t i = 0; i < GC.mark_workers.count; i++) {
+        MarkWorker *victim = &GC.mark_workers.ptr[(id + i) % GC.mark_workers.count];
+        if (__atomic_load_n(&victim->shared.len, __ATOMIC_RELAXED) == 0) continue;
+
+        pthread_mutex_lock(&victim->lock);
+        size_t len = victim->shared.len;
+        size_t take = (len + 1) / 2;
+        for (size_t j = len - take; j < len; j++)
+            _GC_gray_vec_append(&w->local, victim->shared.ptr[j]);
+        __atomic_store_n(&victim->shared.len, len - take, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&victim->lock);
+        if (take > 0) return true;
+    }
+    return false;
+}
+
+static bool _GC_any_shared_grays(void)
+{
+    for (size_t i = 0; i < GC.mark_workers.count; i++)
+        if (__atomic_load_n(&GC.mark_workers.ptr[i].shared.len, __ATOMIC_RELAXED) > 0) return true;
+    return false;
+}
+
+/* marking is done when every thread is idle. A thread only goes idle with
+ * its shared stack empty and nobody else can fill it, so once they all are
+ * there's nothing left anywhere */
+static void _GC_parallel_mark_job(size_t id, void *arg)
+{
+    (void)arg;
+    MarkWorker *w = &GC.mark_workers.ptr[id];
+    mark_worker = w;
+    for (;;) {
+        while (w->local.len > 0) {
+            _GC_scan_gray(w->local.ptr[--w->local.len]);
+            if (w->local.len >= 2 * GC_SHARE_BATCH && __atomic_load_n(&w->shared.len, __ATOMIC_RELAXED) == 0)
+                _GC_share_grays(w);
+        }
+        if (_GC_steal_grays(w, id)) continue;
+
+        __atomic_fetch_add(&GC.mark_workers.idle, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (__atomic_load_n(&GC.mark_workers.idle, __ATOMIC_SEQ_CST) == GC.mark_workers.count) {
+                mark_worker = NULL;
+                return;
+            }
+            if (_GC_any_shared_grays()) break;
+            sched_yield();
+        }
+        __atomic_fetch_sub(&GC.mark_workers.idle, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* deals the mark stack out to the gc threads and drains it with all of them */
+static void _GC_parallel_drain(void)
+{
+    size_t count = workers_count();
+    if (GC.mark_workers.ptr == NULL) {
+        GC.mark_workers.ptr = calloc(count, sizeof(MarkWorker));
+        CHECK_ALLOC(GC.mark_workers.ptr);
+        for (size_t i = 0; i < count; i++)
+            pthread_mutex_init(&GC.mark_workers.ptr[i].lock, NULL);
+        GC.mark_workers.count = count;
+    }
+
+    for (size_t i = 0; i < GC.mark_stack.len; i++)
+        _GC_gray_vec_append(&GC.mark_workers.ptr[i % count].local, GC.mark_stack.ptr[i]);
+    GC.mark_stack.len = 0;
+    GC.mark_workers.idle = 0;
+    workers_run(_GC_parallel_mark_job, NULL);
+}
+
+static void _GC_drain_mark_stack(void)
+{
+    if (workers_count() > 1 && GC.mark_stack.len > 0) _GC_parallel_drain();
+    else _GC_drain_mark_stack_until(0);
+}
+
+static inline size_t _GC_old(void)
+{
+    return GC.live_objects + GC.live_environments - GC.young;
+}
+
+/* frees the unmarked young objects and makes the rest old */
+static void _GC_sweep_young_objects(void)
+{
+    for (size_t i = 0; i < GC.young_objects.len; i++) {
+        Object *o = GC.young_objects.ptr[i];
+        DBG("sweeping object %p", o);
+        if (heap_is_marked(o)) {
+            heap_unmark(o);
+            o->old = true;
+        } else {
+            object_free(o);
+            GC.live_objects--;
+        }
+    }
+
+    GC.young_objects.len = 0;
+}
+
+/* called by the heap as it sweeps its pages, which clears the marks after */
+static bool _GC_is_garbage(Object *o)
+{
+    if (!heap_is_marked(o)) {
+        _object_free_payload(o);
+        GC.live_objects--;
+        return true;
+    }
+    o->old = true;
+    return false;
+}
+
+static void _GC_sweep_young_envs(void)
 {
     /* thank you baby's first garbage collector for showing me the proper way to do this
      * https://journal.stuffwithstuff.com/2013/12/08/babys-first-garbage-collector/
      * I originally did this wrong without the double ptr and paid the price in debuging time */
-    {
-        Object **o = &GC.obj_list;
-        while (*o) {
-            DBG("sweeping object %p", o);
-            if ((*o)->gc_mark == NOT_MARKED) {
-                Object *unreachable = *o;
-                *o = unreachable->obj_next;
-                object_free(unreachable);
-                GC.live_objects--;
-            } else {
-                /* reset the object */
-                (*o)->gc_mark = NOT_MARKED; 
-                o = &(*o)->obj_next;
-            }
+    Env **e = &GC.env_list;
+    while (*e) {
+        DBG("sweeping environment %p", e);
+        if ((*e)->gc_mark == NOT_MARKED) {
+            Env *unreachable = *e;
+            *e = unreachable->env_next;
+            _env_recycle(unreachable);
+            GC.live_environments--;
+        } else {
+            (*e)->gc_mark = NOT_MARKED;
+            (*e)->old = true;
+            e = &(*e)->env_next;
         }
     }
-    {
-        Env **e = &GC.env_list;
-        while (*e) {
-            DBG("sweeping environment %p", e);
-            if ((*e)->gc_mark == NOT_MARKED) {
-                Env *unreachable = *e;
-                *e = unreachable->env_next;
-                env_free(unreachable);
-                GC.live_environments--;
-            } else {
-                (*e)->gc_mark = NOT_MARKED;
-                e = &(*e)->env_next;
-            }
+
+    /* what's left goes to the front of the old generation */
+    *e = GC.old_env_list;
+    GC.old_env_list = GC.env_list;
+    GC.env_list = NULL;
+}
+
+/* sweeps up to count environments of a major collection, returns false
+ * once there are none left */
+static bool _GC_sweep_old_envs(size_t count)
+{
+    for (; count > 0 && GC.unswept_envs; count--) {
+        Env *e = GC.unswept_envs;
+        GC.unswept_envs = e->env_next;
+        if (e->gc_mark == NOT_MARKED) {
+            _env_recycle(e);
+            GC.live_environments--;
+        } else {
+            e->gc_mark = NOT_MARKED;
+            e->old = true;
+            e->env_next = GC.old_env_list;
+            GC.old_env_list = e;
         }
     }
+    return GC.unswept_envs != NULL;
+}
 
+/* these drain the mark stack right away, so marking a deep vm stack
+ * doesn't pile up a gray entry for every frame. Unless an incremental
+ * collection is just starting, then the draining is done in steps, or
+ * there are gc threads, then the roots are what they start from */
+static inline bool _GC_drain_roots_now(void)
+{
+    return (GC.phase != GC_MARKING || GC.max_pause == 0) && workers_count() == 1;
 }
 
-void _GC_collect_garbage(Env *e, ...)
+void GC_mark_object(Object *o)
+{
+    _GC_mark_object(o);
+    if (_GC_drain_roots_now()) _GC_drain_mark_stack();
+}
+
+void GC_mark_env(Env *e)
+{
+    _GC_mark_env(e);
+    if (_GC_drain_roots_now()) _GC_drain_mark_stack();
+}
+
+void GC_remember_object(Object *o)
+{
+    if (GC.remembered_objects.capacity == 0) {
+        GC.remembered_objects.capacity = 64;
+        GC.remembered_objects.ptr = malloc(sizeof(Object *) * GC.remembered_objects.capacity);
+        CHECK_ALLOC(GC.remembered_objects.ptr);
+    }
+    o->remembered = true;
+    da_append(GC.remembered_objects, o);
+}
+
+void GC_remember_env(Env *e)
+{
+    if (GC.remembered_envs.capacity == 0) {
+        GC.remembered_envs.capacity = 64;
+        GC.remembered_envs.ptr = malloc(sizeof(Env *) * GC.remembered_envs.capacity);
+        CHECK_ALLOC(GC.remembered_envs.ptr);
+    }
+    e->remembered = true;
+    da_append(GC.remembered_envs, e);
+}
+
+static void _GC_forget_remembered(void)
+{
+    for (size_t i = 0; i < GC.remembered_objects.len; i++)
+        GC.remembered_objects.ptr[i]->remembered = false;
+    for (size_t i = 0; i < GC.remembered_envs.len; i++)
+        GC.remembered_envs.ptr[i]->remembered = false;
+    GC.remembered_objects.len = 0;
+    GC.remembered_envs.len = 0;
+}
+
+static void _GC_push_root(void **ptr, bool is_env)
+{
+    if (GC.roots.capacity == 0) {
+        GC.roots.capacity = 64;
+        GC.roots.ptr = malloc(sizeof(GCRoot) * GC.roots.capacity);
+        CHECK_ALLOC(GC.roots.ptr);
+    }
+    da_append(GC.roots, ((GCRoot) { .ptr = ptr, .is_env = is_env }));
+}
+
+void GC_push_root(Object **root)
+{
+    _GC_push_root((void **)root, false);
+}
+
+void GC_push_env_root(Env **root)
+{
+    _GC_push_root((void **)root, true);
+}
+
+void GC_pop_roots(size_t count)
+{
+    assert(count <= GC.roots.len);
+    GC.roots.len -= count;
+}
+
+size_t GC_root_count(void)
+{
+    return GC.roots.len;
+}
+
+void GC_restore_roots(size_t count)
+{
+    assert(count <= GC.roots.len);
+    GC.roots.len = count;
+}
+
+bool GC_should_collect(void)
+{
+#ifdef GC_STRESS
+    /* collect at every safe point to find missing roots */
+    return true;
+#else
+    return GC.young >= GC.next_step;
+#endif
+}
+
+void GC_set_max_pause(double ms)
+{
+    GC.max_pause = ms;
+}
+
+void GC_set_threads(size_t count)
+{
+    workers_set_count(count);
+}
+
+static void _GC_mark_roots(Env *e, Object **extra)
 {
     if (e) _GC_mark_env(e);
+    vm_mark_roots();
+    for (size_t i = 0; i < GC.frames.len; i++)
+        _GC_mark_env(GC.frames.ptr[i]);
+
+    for (size_t i = 0; i < GC.roots.len; i++) {
+        void *root = *GC.roots.ptr[i].ptr;
+        if (root == NULL) continue;
+        if (GC.roots.ptr[i].is_env) _GC_mark_env(root);
+        else _GC_mark_object(root);
+    }
+
+    for (; *extra; extra++) 
+        _GC_mark_object(*extra);
+}
+
+/* frames on the stack aren't swept, so their marks are cleared once
+ * marking is done */
+static void _GC_unmark_frames(void)
+{
+    for (size_t i = 0; i < GC.frames.len; i++)
+        GC.frames.ptr[i]->gc_mark = NOT_MARKED;
+}
 
+static void _GC_collect_minor(Env *e, Object **extra)
+{
+    GC.minor = true;
+    _GC_mark_roots(e, extra);
+
+    /* old objects that were written to might be the only
+     * thing pointing to some young ones */
+    for (size_t i = 0; i < GC.remembered_objects.len; i++)
+        _GC_mark_object_children(GC.remembered_objects.ptr[i]);
+    for (size_t i = 0; i < GC.remembered_envs.len; i++)
+        _GC_mark_env_children(GC.remembered_envs.ptr[i]);
+    _GC_drain_mark_stack();
+    _GC_unmark_frames();
+
+    /* everything that survives is old, so nothing old points to anything young anymore */
+    _GC_forget_remembered();
+    _GC_sweep_young_objects();
+    _GC_sweep_young_envs();
+    GC.young = 0;
+
+    GC.minor = false;
+    GC.minor_collections++;
+}
+
+static void _GC_start_marking(Env *e, Object **extra)
+{
+    GC.phase = GC_MARKING;
+    GC_marking = true;
+    _GC_mark_roots(e, extra);
+}
+
+/* the last pause of marking, marks what the roots and the stores into
+ * marked objects picked up while it was going on. Then the sweep starts */
+static void _GC_finish_marking(Env *e, Object **extra)
+{
+    _GC_mark_roots(e, extra);
+    for (size_t i = 0; i < GC.remembered_objects.len; i++) {
+        Object *o = GC.remembered_objects.ptr[i];
+        if (heap_is_marked(o)) _GC_mark_object_children(o);
+    }
+    for (size_t i = 0; i < GC.remembered_envs.len; i++) {
+        Env *env = GC.remembered_envs.ptr[i];
+        if (env->gc_mark == MARKED) _GC_mark_env_children(env);
+    }
+    _GC_drain_mark_stack();
+    _GC_unmark_frames();
+    _GC_forget_remembered();
+    GC_marking = false;
+
+    /* the young generation is swept along with the old one, whatever
+     * survives is old */
+    for (size_t i = 0; i < GC.young_objects.len; i++)
+        if (heap_is_marked(GC.young_objects.ptr[i])) GC.young_objects.ptr[i]->old = true;
+    GC.young_objects.len = 0;
+
+    Env **young_envs_end = &GC.env_list;
+    while (*young_envs_end) young_envs_end = &(*young_envs_end)->env_next;
+    *young_envs_end = GC.old_env_list;
+    GC.unswept_envs = GC.env_list;
+    GC.env_list = GC.old_env_list = NULL;
+    GC.young = 0;
+
+    heap_start_sweep(_GC_is_garbage);
+    GC.phase = GC_SWEEPING;
+    GC.major_collections++;
+}
+
+static void _GC_finish_sweep(void)
+{
+    heap_finish_sweep();
+    while (_GC_sweep_old_envs(SIZE_MAX));
+    GC.phase = GC_IDLE;
+    GC.next_major = MAX(GC_MIN_OLD, _GC_old() * GC_GROWTH_FACTOR);
+}
+
+/* sweeps a bit, or until the deadline (in ms, 0 for none) */
+static void _GC_sweep_step(double deadline)
+{
+    for (;;) {
+        bool pages_left = true;
+        for (size_t i = 0; i < GC_SWEEP_STEP_PAGES && pages_left; i++)
+            pages_left = heap_sweep_page();
+        bool envs_left = _GC_sweep_old_envs(GC_SWEEP_STEP_ENVS);
+
+        if (!pages_left && !envs_left) {
+            _GC_finish_sweep();
+            return;
+        }
+        if (!deadline || _GC_now() >= deadline) return;
+    }
+}
+
+static void _GC_record_pause(double ms)
+{
+    size_t bucket = 0;
+    while (bucket < PAUSE_BUCKETS - 1 && ms >= pause_limits[bucket]) bucket++;
+    GC.pauses.buckets[bucket]++;
+    GC.pauses.count++;
+    GC.pauses.total += ms;
+    if (ms > GC.pauses.max) GC.pauses.max = ms;
+}
+
+static void _GC_extra_roots(Object **extra, va_list ap)
+{
+    size_t len = 0;
+    Object *o;
+    while ((o = va_arg(ap, Object *)) != NULL) {
+        assert(len < GC_MAX_EXTRA_ROOTS);
+        extra[len++] = o;
+    }
+    extra[len] = NULL;
+}
+
+void _GC_collect_step(Env *e, ...)
+{
+    double start = _GC_now();
+    double deadline = GC.max_pause > 0 ? start + GC.max_pause : 0;
+
+    Object *extra[GC_MAX_EXTRA_ROOTS + 1];
     va_list ap;
     va_start(ap, e);
-    Object *to_mark;
-    while ((to_mark = va_arg(ap, Object*)) != NULL)
-        _GC_mark_object(to_mark);
+    _GC_extra_roots(extra, ap);
+    va_end(ap);
+
+    switch (GC.phase) {
+        case GC_IDLE: {
+            _GC_collect_minor(e, extra);
+            if (_GC_old() >= GC.next_major) {
+                _GC_start_marking(e, extra);
+                if (!deadline || _GC_drain_mark_stack_until(deadline))
+                    _GC_finish_marking(e, extra);
+            }
+        } break;
+        case GC_MARKING: {
+            /* no minor collections until marking is done, the nursery is
+             * swept with everything else after */
+            if (_GC_drain_mark_stack_until(deadline))
+                _GC_finish_marking(e, extra);
+        } break;
+        case GC_SWEEPING: {
+            if (GC.young >= GC_NURSERY_SIZE) _GC_collect_minor(e, extra);
+            _GC_sweep_step(deadline);
+        } break;
+    }
 
+    GC.next_step = GC.phase == GC_IDLE ? GC_NURSERY_SIZE : GC.young + GC_STEP_INTERVAL;
+    workers_flush();
+    _GC_record_pause(_GC_now() - start);
+}
+
+void _GC_collect_garbage(Env *e, ...)
+{
+    double start = _GC_now();
+
+    Object *extra[GC_MAX_EXTRA_ROOTS + 1];
+    va_list ap;
+    va_start(ap, e);
+    _GC_extra_roots(extra, ap);
     va_end(ap);
 
-    _GC_sweep();
+    /* finish whatever collection is going on, then do a whole one */
+    if (GC.phase == GC_MARKING) _GC_finish_marking(e, extra);
+    if (GC.phase == GC_SWEEPING) _GC_finish_sweep();
+    _GC_start_marking(e, extra);
+    _GC_finish_marking(e, extra);
+    _GC_finish_sweep();
+
+    GC.next_step = GC_NURSERY_SIZE;
+    workers_flush();
+    _GC_record_pause(_GC_now() - start);
 }
 
 void GC_debug_print_status(void)
@@ -484,8 +1826,27 @@ void GC_debug_print_status(void)
     fprintf(stderr, "GC status:\n"
             "\tlive objects: %zu\n"
             "\tlive environments: %zu\n"
-            "\tobj_list: %p\n"
+            "\tyoung: %zu\n"
+            "\told: %zu (next major collection at %zu)\n"
+            "\tminor collections: %zu\n"
+            "\tmajor collections: %zu (%s)\n"
+            "\tmark stack: %zu deep at most, room for %zu\n"
+            "\tframe stack: %zu frames, %zu at most, %zu escaped\n"
+            "\tenv pool: %zu environments reused, %zu arenas reused (%zu pooled)\n"
             "\tenv_list: %p\n",
-            GC.live_objects, GC.live_environments, GC.obj_list, GC.env_list);
+            GC.live_objects, GC.live_environments, GC.young, _GC_old(), GC.next_major,
+            GC.minor_collections, GC.major_collections, gc_phase_string[GC.phase],
+            GC.mark_stack_peak, GC.mark_stack.capacity,
+            GC.frames.len, GC.frames_peak, GC.frames_escaped,
+            GC.pool.envs_reused, GC.pool.arenas_reused, GC.pool.arena_count, GC.env_list);
+    if (GC.max_pause > 0) fprintf(stderr, "\tmax pause: %gms\n", GC.max_pause);
+    fprintf(stderr, "\tpauses: %zu, %.3fms at most, %.3fms in total\n",
+            GC.pauses.count, GC.pauses.max, GC.pauses.total);
+    for (size_t i = 0; i < PAUSE_BUCKETS; i++) {
+        if (i < PAUSE_BUCKETS - 1) fprintf(stderr, "\t\t< %gms: ", pause_limits[i]);
+        else fprintf(stderr, "\t\t>= %gms: ", pause_limits[i - 1]);
+        fprintf(stderr, "%zu\n", GC.pauses.buckets[i]);
+    }
+    heap_debug_print_status();
+    workers_debug_print_status();
 }
-
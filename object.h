@@ -10,13 +10,34 @@
 #include <gmp.h>
 #include "arena.h"
 
+/* the mark of an environment, objects are marked in the heap's bitmaps */
 typedef enum { MARKED, NOT_MARKED } Mark;
 
 typedef struct Object Object;
 
+/* 32 bit sizes keep an object at 3 words. Strings never change, a string
+ * builder is the same thing with room to grow */
 struct StringSlice {
     char *ptr;
-    size_t len, capacity;
+    uint32_t len, capacity;
+};
+
+/* a growable array of values, the items are allocated from the heap like
+ * string bodies */
+struct Vector {
+    Object **items;
+    uint32_t len, capacity;
+};
+
+/* a node of a map or set, see map.h */
+struct MapEntry {
+    Object *key; /* NULL if value is the node one level down */
+    Object *value;
+};
+struct Map {
+    struct MapEntry *entries; /* allocated from the heap */
+    uint32_t bitmap; /* 0 in a collision node */
+    uint32_t count; /* keys in this node and the ones under it */
 };
 
 struct List {
@@ -24,11 +45,25 @@ struct List {
     Object *cdr;
 };
 
+/* an integer, only the ones that don't fit in a long get a gmp bignum.
+ * see number.h */
+struct Num {
+    bool is_big;
+    union {
+        long small;
+        mpz_ptr big; /* malloc'd */
+    };
+};
+
 #define ERROR_NUM_MAX_STR_SIZE 256
 
 enum ObjectKind {
     O_NIL = 0,
-    O_STR, O_NUM, O_LIST, O_IDENT, O_ERROR, O_BUILTIN, O_FUNCTION, O_CHAR,
+    O_STR, O_NUM, O_LIST, O_IDENT, O_ERROR, O_BUILTIN, O_FUNCTION, O_CHAR, O_VECTOR,
+    O_MAP, O_SET, O_STRING_BUILDER,
+    /* internal kinds made by the resolver (see resolve.h). They only
+     * appear inside of resolved function bodies, never as values */
+    O_LOCAL, O_LAMBDA, O_LET,
 };
 
 
@@ -41,37 +76,135 @@ struct EnvValueStore {
     EnvValueStore *left; /* nullable, <ident */
     EnvValueStore *right; /* nullable, >ident */
 };
+/* global environments keep their bindings in an open addressing hash
+ * table, see env_put. The bindings themselves are allocated from the
+ * environment's arena, so they stay put when the table grows */
+typedef struct {
+    Object *ident;
+    Object *value;
+} EnvBinding;
+typedef struct {
+    size_t count;
+    size_t capacity; /* a power of 2 */
+    EnvBinding *buckets[]; /* NULL for an empty bucket */
+} EnvTable;
+
 typedef struct Env Env;
 struct Env {
     Env *env_next; /* nullable - for gc */
     Mark gc_mark;
+    bool old, remembered; /* see GC_write_barrier */
+    /* a frame on the frame stack, see env_push_frame. It escaped if
+     * something on the heap might point to it once it's popped */
+    bool on_stack, escaped;
     Env *parent; /* nullable */
-    EnvValueStore *store; /* nullable */
-    Arena *arena;
+    EnvValueStore *store; /* nullable - bindings made at runtime (def, load, ...) */
+    EnvTable *table; /* nullable - instead of the store if there's no scope */
+    Arena *arena; /* nullable - made for the store when it's needed */
+
+    /* lexically addressed bindings. A frame made for a lambda call or a let
+     * has one slot per name in its scope, a NULL slot is not bound yet */
+    Object *scope; /* nullable - the O_LAMBDA or O_LET this frame is for */
+    size_t slot_count;
+    Object **slot_names;
+    Object *slots[]; /* flexible array member */
+};
+
+/* a reference to slot `slot` of the frame `depth` parents up */
+struct Local {
+    Object *ident;
+    uint32_t depth;
+    uint32_t slot;
+};
+
+/* where a variable a flat lambda captures is, in the frames it's made in */
+struct Capture {
+    uint32_t depth;
+    uint32_t slot;
+};
+
+struct Lambda {
+    Object *arguments; /* original argument list, for printing */
+    Object *body; /* original body, for printing */
+    Object *resolved; /* body with the local variables resolved */
+    size_t required; /* number of parameters before the & */
+    bool variadic; /* slot `required` takes the rest of the arguments */
+    size_t slot_count;
+    /* a flat lambda closes over a frame with just the values it captures,
+     * instead of the whole environment it's made in (see resolve.h) */
+    bool flat;
+    size_t capture_count;
+    struct Capture *captures; /* nullable */
+    Object **capture_names; /* nullable */
+    struct Code *code; /* nullable - compiled the first time it runs */
+    Object *names[]; /* flexible array member */
+};
+
+struct Let {
+    Object *resolved; /* body */
+    bool loop; /* made by loop, a recur in its body binds it again */
+    size_t binding_count;
+    size_t *binding_slots;
+    Object **binding_values; /* resolved */
+    size_t slot_count;
+    Object *names[]; /* flexible array member */
 };
 
 struct Function {
-    Object *arguments;
-    Object *body;
+    Object *lambda; /* O_LAMBDA */
     Env *env;
 };
 
+/* Builtins come in two kinds. A Builtin gets its arguments unevaluated,
+ * that's how special forms like if and def work. A primitive is called
+ * with its arguments already evaluated, and only after the caller checked
+ * there are min_args to max_args of them. argv is only good until it
+ * returns. Plugins loaded with import-shared can export either kind */
 typedef Object *(*Builtin)(Env*, Object*);
+typedef Object *(*Primitive)(Object **argv, size_t argc);
+enum {
+    /* no side effects and the same arguments give the same result, so the
+     * compiler can call it on constants ahead of time */
+    PRIM_PURE = 1 << 0,
+    /* not inlined by the compiler, calls to it go through OP_CALL. For
+     * apply, which the vm turns into a call of its own (see vm.c) */
+    PRIM_NO_INLINE = 1 << 1,
+};
+typedef struct {
+    const char *name;
+    Primitive fn;
+    size_t min_args, max_args; /* max_args is SIZE_MAX if there's no limit */
+    unsigned flags;
+} PrimitiveDef;
+
 struct Object {
-    Object *obj_next; /* nullable - for garbage collector */
-    Mark gc_mark;
-    
-    enum ObjectKind kind;
+    /* the header fits in one word, see heap.h for the mark bits */
+    enum ObjectKind kind : 8;
     bool eval;
+    /* interned identifiers and shared values live outside of the heap
+     * and are never marked or swept */
+    bool permanent;
+    bool free; /* an empty slot in the heap */
+    bool old, remembered; /* see GC_write_barrier */
     union {
         struct StringSlice str;
-        mpz_t num;
+        struct Num num;
         struct List list;
-        Builtin builtin;
+        struct Vector vector;
+        struct Map map;
+        struct {
+            Builtin builtin; /* NULL for a primitive */
+            const PrimitiveDef *prim; /* NULL for a Builtin */
+        };
         struct Function function;
         char character;
+        struct Local local;
+        struct Lambda *lambda;
+        struct Let *let;
+        Object *free_next; /* free objects, see heap.c */
    };
 };
+_Static_assert(sizeof(Object) == 3 * sizeof(void *), "objects should be 3 words");
 
 Object *object_new_generic(void);
 Object *object_list_new(Object *car, Object *cdr);
@@ -79,18 +212,50 @@ Object *object_string_slice_new(const char *s, size_t len);
 Object *object_string_slice_new_cstr(const char *s);
 // returns malloc'ed zero-terminated "c string"
 char *object_string_slice_to_cstr(Object *str);
+/* identifiers are interned: every identifier with the same name shares
+ * the same name buffer, so two identifiers are equal iff their str.ptr is.
+ * each name has exactly two identifier objects, the evaluated one returned
+ * here and a quoted one (see object_ident_with_eval) */
 Object *object_ident_new(const char *s, size_t len);
 Object *object_ident_new_cstr(const char *s);
+Object *object_ident_with_eval(Object *ident, bool eval);
+uint64_t object_ident_hash(Object *ident);
+#define IDENT_EQ(a, b) ((a)->str.ptr == (b)->str.ptr)
+/* nil, chars and small numbers are shared, so the objects returned for
+ * them must not be changed. Use object_num_new_mutable for a number that
+ * is changed in place and object_with_eval to quote something */
 Object *object_num_new(int64_t num);
+/* takes over n */
+Object *object_num_new_num(struct Num *n);
+Object *object_num_new_mutable(int64_t num);
 Object *object_num_new_token(Token *t);
 Object *object_nil_new(void);
+Object *object_with_eval(Object *o, bool eval);
 Object *object_builtin_new(Builtin f);
+/* def has to outlive the object */
+Object *object_primitive_new(const PrimitiveDef *def);
 const char *object_type_as_string(enum ObjectKind k);
 // WARNING: must have on_error jmpbuf set up before using
 Object *object_error_new(const char *fmt, ...);
 Object *object_error_new_from_string_slice(Object *o);
-Object *object_function_new(Env *e, Object *args, Object *body);
+Object *object_function_new(Env *e, Object *lambda);
 Object *object_char_new(char c);
+/* an empty vector with room for capacity items */
+Object *object_vector_new(size_t capacity);
+/* appends value, growing v if it has to */
+void object_vector_push(Object *v, Object *value);
+/* an empty string builder */
+Object *object_string_builder_new(void);
+/* appends len bytes of s, growing b if it has to */
+void object_string_builder_append(Object *b, const char *s, size_t len);
+/* structural equality, what = does */
+bool object_equal(Object *a, Object *b);
+/* what maps compare keys with. Like object_equal, but vectors and string
+ * builders can be changed after they're put in a map, so they're only
+ * equal to themselves */
+bool object_key_equal(Object *a, Object *b);
+/* objects that are object_key_equal hash the same */
+uint64_t object_hash(Object *o);
 Object *object_shallow_copy(Object *o);
 void object_print(Object *o);
 void object_free(Object *o);
@@ -98,6 +263,48 @@ void object_free(Object *o);
 #define GC_collect_garbage(env, ...) \
     _GC_collect_garbage(env __VA_OPT__(,) __VA_ARGS__, NULL);
 void _GC_collect_garbage(Env *e, ...);
+/* does the next bit of garbage collection once enough has been allocated:
+ * collects the nursery, or does a step of a major collection. Only use it
+ * at a safe point: everything live must be reachable from env, the vm, the
+ * roots or the extra objects passed */
+#define GC_maybe_collect(env, ...) \
+    do { if (GC_should_collect()) _GC_collect_step(env __VA_OPT__(,) __VA_ARGS__, NULL); } while (0)
+void _GC_collect_step(Env *e, ...);
+bool GC_should_collect(void);
+/* with a max pause (in milliseconds) major collections mark in steps that
+ * take about that long, instead of all at once. 0 turns it off */
+void GC_set_max_pause(double ms);
+/* marks with count threads at once and frees in the background when it's
+ * more than 1. Only set it once, before anything is evaluated */
+void GC_set_threads(size_t count);
+/* a minor collection doesn't look inside of old objects, and an
+ * incremental one doesn't look at an object again once it's marked, so
+ * storing a pointer into an object or environment that already existed at
+ * the last safe point has to be followed by a write barrier. Objects that
+ * are filled in right after they're made don't need one */
+extern bool GC_marking; /* an incremental collection is marking */
+void GC_remember_object(Object *o);
+void GC_remember_env(Env *e);
+static inline void GC_write_barrier(Object *o)
+{
+    if ((o->old || GC_marking) && !o->remembered && !o->permanent) GC_remember_object(o);
+}
+static inline void GC_env_write_barrier(Env *e)
+{
+    if ((e->old || GC_marking) && !e->remembered) GC_remember_env(e);
+}
+/* every function call is a safe point, so C code (builtins included) that
+ * holds on to an object while evaluating something has to register the
+ * variable as a root until it's done. Roots are popped in reverse order,
+ * eval() drops the ones left over when an error longjmps out */
+void GC_push_root(Object **root);
+void GC_push_env_root(Env **root);
+void GC_pop_roots(size_t count);
+size_t GC_root_count(void);
+void GC_restore_roots(size_t count);
+/* for marking roots that live outside of the gc, like the vm's stacks */
+void GC_mark_object(Object *o);
+void GC_mark_env(Env *e);
 void GC_debug_print_status(void);
 
 #endif
@@ -4,6 +4,7 @@
 #include "parser.h"
 #include "object.h"
 #include "util.h"
+#include "heap.h"
 
 static Object *_parser_parse_expr(Parser *p);
 static Object *_parse_list(Parser *p);
@@ -49,7 +50,9 @@ static Object *_parser_parse_expr(Parser *p)
             if (p->error) break;
             ret = _parser_parse_expr(p);
             if (p->error) { ret = NULL; break; }
-            ret->eval = false;
+            /* identifiers and some values are shared, so quoting one
+             * means using its quoted twin instead of mutating it */
+            ret = object_with_eval(ret, false);
         } break; 
         case t_STR: {
             ret = _parser_parse_string_token(current_token);
@@ -134,8 +137,7 @@ static Object *_parser_parse_string_token(Token *t)
     Object *ret = object_new_generic();
     ret->kind = O_STR;
     ret->str.capacity = t->string_slice.len;
-    ret->str.ptr = malloc(sizeof(char) * ret->str.capacity);
-    CHECK_ALLOC(ret->str.ptr);
+    ret->str.ptr = heap_alloc(sizeof(char) * ret->str.capacity);
     
     const char *str = t->string_slice.ptr;
     size_t len = t->string_slice.len;
@@ -0,0 +1,489 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "resolve.h"
+#include "environment.h"
+#include "eval.h"
+#include "util.h"
+
+typedef struct Closure Closure;
+
+/* a lexical scope that is being resolved, these only live on the C stack */
+typedef struct Scope Scope;
+struct Scope {
+    Object **names;
+    size_t count;
+    /* a let's slots can still change while its bindings run, binding is
+     * the one being resolved (binding_count once it's the body) */
+    struct Let *let; /* nullable */
+    size_t binding;
+    bool may_def; /* something might be def'd into its frame, see _may_def */
+    Scope *parent; /* nullable - then the runtime environment is searched */
+    Closure *closure; /* nullable - the scope is what a flat lambda captures */
+};
+
+/* the captures of a flat lambda that is being resolved. Its body only
+ * sees its parameters and what it captures, any other variable is looked
+ * up where the lambda is made and added to the captures */
+struct Closure {
+    Scope *outer; /* nullable */
+    Env *e;
+    bool flat; /* cleared if the lambda can't be flat after all */
+    struct { size_t len, capacity; Object **ptr; } names;
+    struct { size_t len, capacity; struct Capture *ptr; } from;
+};
+
+static struct {
+    Object *lambda, *let, *loop, *def, *ampersand, *load, *eval, *import_shared;
+} idents = { NULL };
+
+/* if the frames of the runtime environment that's being resolved in might
+ * have things def'd into them, see _scope_may_def */
+static bool runtime_may_def = false;
+
+/* the name of the def whose value is being resolved, if any */
+static Object *defining = NULL;
+
+static Object *_resolve(Scope *s, Env *e, Object *o);
+
+static void _init_idents(void)
+{
+    if (idents.lambda) return;
+    idents.lambda = object_ident_new_cstr("\\");
+    idents.let = object_ident_new_cstr("let");
+    idents.loop = object_ident_new_cstr("loop");
+    idents.def = object_ident_new_cstr("def");
+    idents.ampersand = object_ident_new_cstr("&");
+    idents.load = object_ident_new_cstr("load");
+    idents.eval = object_ident_new_cstr("eval");
+    idents.import_shared = object_ident_new_cstr("import-shared");
+}
+
+static bool _capture(Closure *c, Object *ident, uint32_t *slot);
+
+/* if the let's slot is bound for good once binding is evaluated */
+static bool _let_slot_fixed(struct Let *let, size_t binding, size_t slot)
+{
+    for (size_t i = binding; i < let->binding_count; i++)
+        if (let->binding_slots[i] == slot) return false;
+    return true;
+}
+
+/* slots are searched from the back to match env_get. fixed is cleared if
+ * the variable might not be bound yet, or bound again, after the point
+ * it's looked up from */
+static bool _lookup(Scope *s, Env *e, Object *ident, uint32_t *depth, uint32_t *slot, bool *fixed)
+{
+    uint32_t d = 0;
+    for (; s; s = s->parent, d++) {
+        Object **names = s->closure ? s->closure->names.ptr : s->names;
+        size_t count = s->closure ? s->closure->names.len : s->count;
+        for (size_t i = count; i-- > 0;) {
+            if (IDENT_EQ(names[i], ident)) {
+                *depth = d; *slot = (uint32_t)i;
+                if (s->let && !_let_slot_fixed(s->let, s->binding, i)) *fixed = false;
+                return true;
+            }
+        }
+
+        /* nothing past a flat lambda's captures is visible from its body */
+        if (s->closure) {
+            if (!_capture(s->closure, ident, slot)) return false;
+            *depth = d;
+            return true;
+        }
+    }
+
+    /* the frames the lambda or let is being made in are
+     * just as fixed as the ones we are resolving */
+    for (; e; e = e->parent, d++) {
+        for (size_t i = e->slot_count; i-- > 0;) {
+            if (IDENT_EQ(e->slot_names[i], ident)) {
+                *depth = d; *slot = (uint32_t)i;
+                if (e->slots[i] == NULL) *fixed = false;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* looks ident up where the flat lambda is made, and captures it if it's a
+ * variable there */
+static bool _capture(Closure *c, Object *ident, uint32_t *slot)
+{
+    uint32_t from_depth, from_slot;
+    bool fixed = true;
+    if (!_lookup(c->outer, c->e, ident, &from_depth, &from_slot, &fixed)) return false;
+    /* like a let binding refering to itself, the lambda has to
+     * see the binding that's made after it */
+    if (!fixed) c->flat = false;
+
+    da_append(c->names, ident);
+    da_append(c->from, ((struct Capture) { .depth = from_depth, .slot = from_slot }));
+    *slot = (uint32_t)(c->names.len - 1);
+    return true;
+}
+
+/* \, let and loop are only the special forms while they're bound to them,
+ * like the ones the compiler knows, they can be def'd to something else.
+ * Inside of (def name ...) name is taken to be the function that's being
+ * defined */
+static bool _is_form(Env *e, Object *head, Object *name, enum SpecialForm sf)
+{
+    if (!IDENT_EQ(head, name)) return false;
+    if (defining && IDENT_EQ(defining, name)) return false;
+    return eval_special_form(env_lookup(e, head)) == sf;
+}
+
+/* if ident might be eval, load or import-shared. They can be called under
+ * another name or passed to another function like (map eval xs), so any
+ * variable that's bound to one of them counts, wherever it's used */
+static bool _is_eval(Env *e, Object *ident)
+{
+    if (IDENT_EQ(ident, idents.load) || IDENT_EQ(ident, idents.eval)
+            || IDENT_EQ(ident, idents.import_shared))
+        return true;
+    enum SpecialForm sf = eval_special_form(env_lookup(e, ident));
+    return sf == SF_EVAL || sf == SF_LOAD || sf == SF_IMPORT_SHARED;
+}
+
+/* if evaluating o might def something into the frame it runs in. def is
+ * recognised by name or by value like the special forms, anything that
+ * might eval counts too. The body of a lambda gets a frame of its own */
+static bool _may_def(Env *e, Object *o)
+{
+    if (!o->eval) return false;
+    if (o->kind == O_IDENT) return _is_eval(e, o);
+    if (o->kind != O_LIST) return false;
+
+    Object *head = o->list.car;
+    if (head->kind == O_IDENT && head->eval) {
+        if (_is_form(e, head, idents.lambda, SF_LAMBDA)) return false;
+        if (IDENT_EQ(head, idents.def) || eval_special_form(env_lookup(e, head)) == SF_DEF)
+            return true;
+    }
+
+    for (; o->kind == O_LIST; o = o->list.cdr)
+        if (_may_def(e, o->list.car)) return true;
+    return false;
+}
+
+/* if o might look up variables by name at runtime, see _is_eval. Unlike
+ * _may_def this looks inside of lambdas too, a flat lambda around one
+ * would leave out what it looks up */
+static bool _may_eval(Env *e, Object *o)
+{
+    if (!o->eval) return false;
+    if (o->kind == O_IDENT) return _is_eval(e, o);
+    if (o->kind != O_LIST) return false;
+
+    for (; o->kind == O_LIST; o = o->list.cdr)
+        if (_may_eval(e, o->list.car)) return true;
+    return false;
+}
+
+/* a lambda made in s can only be flat if nothing is def'd into the frames
+ * in between it and the global environment, it would have to see those */
+static bool _scope_may_def(Scope *s)
+{
+    for (; s; s = s->parent) {
+        if (s->may_def) return true;
+        /* the captures of a flat lambda are never def'd into, and
+         * the frames it was made in aren't visible from it */
+        if (s->closure) return false;
+    }
+    return runtime_may_def;
+}
+
+/* the frames of e up to the first environment that isn't a frame */
+static bool _frames_have_defs(Env *e)
+{
+    for (; e && e->scope; e = e->parent)
+        if (e->store) return true;
+    return false;
+}
+
+/* same checks as _builtin_lambda, a malformed lambda is left alone so
+ * the error is reported when (and if) it's evaluated */
+static bool _lambda_form_ok(Object *o)
+{
+    if (o->kind != O_LIST || o->list.cdr->kind != O_LIST || o->list.cdr->list.cdr->kind != O_NIL)
+        return false;
+
+    Object *cursor = o->list.car;
+    if (cursor->kind != O_LIST && cursor->kind != O_NIL) return false;
+    while (cursor->kind != O_NIL) {
+        if (cursor->kind != O_LIST) return false;
+        if (cursor->list.car->kind != O_IDENT || !cursor->list.car->eval) return false;
+        if (IDENT_EQ(cursor->list.car, idents.ampersand)) {
+            return cursor->list.cdr->kind == O_LIST
+                && cursor->list.cdr->list.car->kind == O_IDENT
+                && cursor->list.cdr->list.cdr->kind == O_NIL;
+        }
+        cursor = cursor->list.cdr;
+    }
+    return true;
+}
+
+/* same checks as _builtin_let */
+static bool _let_form_ok(Object *o)
+{
+    if (o->kind != O_LIST || o->list.cdr->kind != O_LIST) return false;
+
+    Object *vars = o->list.car;
+    while (vars->kind == O_LIST) {
+        if (vars->list.car->kind != O_IDENT) return false;
+        if (vars->list.cdr->kind != O_LIST) return false;
+        vars = vars->list.cdr->list.cdr;
+    }
+    return true;
+}
+
+static Object *_resolve_lambda(Scope *s, Env *e, Object *arguments, Object *body)
+{
+    size_t required = 0;
+    bool variadic = false;
+    for (Object *cursor = arguments; cursor->kind == O_LIST; cursor = cursor->list.cdr) {
+        if (IDENT_EQ(cursor->list.car, idents.ampersand)) {
+            variadic = true;
+            break;
+        }
+        required++;
+    }
+
+    size_t slot_count = required + variadic;
+    struct Lambda *lambda = malloc(sizeof(struct Lambda) + sizeof(Object *) * slot_count);
+    CHECK_ALLOC(lambda);
+    *lambda = (struct Lambda) {
+        .arguments = arguments,
+        .body = body,
+        .resolved = NULL,
+        .required = required,
+        .variadic = variadic,
+        .slot_count = slot_count,
+        .flat = false,
+        .capture_count = 0,
+        .captures = NULL,
+        .capture_names = NULL,
+        .code = NULL,
+    };
+
+    size_t i = 0;
+    for (Object *cursor = arguments; cursor->kind == O_LIST; cursor = cursor->list.cdr) {
+        if (IDENT_EQ(cursor->list.car, idents.ampersand)) continue;
+        lambda->names[i++] = object_ident_with_eval(cursor->list.car, true);
+    }
+    assert(i == slot_count);
+
+    Object *ret = object_new_generic();
+    ret->kind = O_LAMBDA;
+    ret->lambda = lambda;
+
+    Closure closure = {
+        .outer = s,
+        .e = e,
+        /* a body that evals keeps the whole environment, whatever it
+         * looks up by name has to be there */
+        .flat = !_scope_may_def(s) && !_may_eval(e, body),
+        .names = { 0, 4, malloc(sizeof(Object *) * 4) },
+        .from = { 0, 4, malloc(sizeof(struct Capture) * 4) },
+    };
+    CHECK_ALLOC(closure.names.ptr);
+    CHECK_ALLOC(closure.from.ptr);
+    Scope captures = { .names = NULL, .count = 0, .let = NULL, .binding = 0, .may_def = false, .parent = NULL, .closure = &closure };
+    Scope scope = {
+        .names = lambda->names,
+        .count = slot_count,
+        .let = NULL,
+        .binding = 0,
+        .may_def = _may_def(e, body),
+        .parent = &captures,
+        .closure = NULL,
+    };
+
+    /* resolving the body finds what it captures, and if it can be flat */
+    if (closure.flat) lambda->resolved = _resolve(&scope, e, body);
+    if (closure.flat) {
+        lambda->flat = true;
+        lambda->capture_count = closure.names.len;
+        lambda->capture_names = closure.names.ptr;
+        lambda->captures = closure.from.ptr;
+    } else {
+        /* it closes over the whole environment, so resolve it again
+         * with all of the scopes around it visible */
+        free(closure.names.ptr);
+        free(closure.from.ptr);
+        scope.parent = s;
+        lambda->resolved = _resolve(&scope, e, body);
+    }
+
+    return ret;
+}
+
+static Object *_resolve_let(Scope *s, Env *e, Object *bindings, Object *body, bool loop)
+{
+    size_t binding_count = 0;
+    for (Object *vars = bindings; vars->kind == O_LIST; vars = vars->list.cdr->list.cdr)
+        binding_count++;
+
+    struct Let *let = malloc(sizeof(struct Let) + sizeof(Object *) * binding_count);
+    CHECK_ALLOC(let);
+    *let = (struct Let) {
+        .resolved = NULL,
+        .loop = loop,
+        .binding_count = binding_count,
+        .binding_slots = malloc(sizeof(size_t) * binding_count),
+        .binding_values = malloc(sizeof(Object *) * binding_count),
+        .slot_count = 0,
+    };
+    CHECK_ALLOC(let->binding_slots || binding_count == 0);
+    CHECK_ALLOC(let->binding_values || binding_count == 0);
+
+    /* a name bound twice (let (x 1 x (+ x 1)) ...) shares one slot, the
+     * second binding just overwrites the first */
+    size_t i = 0;
+    for (Object *vars = bindings; vars->kind == O_LIST; vars = vars->list.cdr->list.cdr, i++) {
+        Object *name = object_ident_with_eval(vars->list.car, true);
+        size_t slot = 0;
+        while (slot < let->slot_count && !IDENT_EQ(let->names[slot], name)) slot++;
+        if (slot == let->slot_count) let->names[let->slot_count++] = name;
+        let->binding_slots[i] = slot;
+        let->binding_values[i] = NULL;
+    }
+
+    Object *ret = object_new_generic();
+    ret->kind = O_LET;
+    ret->let = let;
+
+    Scope scope = {
+        .names = let->names,
+        .count = let->slot_count,
+        .let = let,
+        .binding = 0,
+        .may_def = _may_def(e, bindings) || _may_def(e, body),
+        .parent = s,
+        .closure = NULL,
+    };
+    for (Object *vars = bindings; vars->kind == O_LIST; vars = vars->list.cdr->list.cdr, scope.binding++)
+        let->binding_values[scope.binding] = _resolve(&scope, e, vars->list.cdr->list.car);
+    let->resolved = _resolve(&scope, e, body);
+
+    return ret;
+}
+
+/* copies the list, resolving every element. An improper tail is kept as is */
+static Object *_resolve_list(Scope *s, Env *e, Object *o)
+{
+    Object *ret = object_list_new(_resolve(s, e, o->list.car), o->list.cdr);
+    ret->eval = o->eval;
+
+    Object *cursor = ret;
+    for (o = o->list.cdr; o->kind == O_LIST; o = o->list.cdr) {
+        cursor->list.cdr = object_list_new(_resolve(s, e, o->list.car), o->list.cdr);
+        cursor = cursor->list.cdr;
+        cursor->eval = o->eval;
+    }
+
+    return ret;
+}
+
+static Object *_resolve(Scope *s, Env *e, Object *o)
+{
+    /* quoted data is never code */
+    if (!o->eval) return o;
+
+    uint32_t depth, slot;
+    bool fixed = true;
+    switch (o->kind) {
+        case O_IDENT: {
+            if (!_lookup(s, e, o, &depth, &slot, &fixed)) return o;
+            Object *ret = object_new_generic();
+            ret->kind = O_LOCAL;
+            ret->local = (struct Local) {
+                .ident = o,
+                .depth = depth,
+                .slot = slot,
+            };
+            return ret;
+        } break;
+
+        case O_LIST: {
+            Object *head = o->list.car;
+            Object *args = o->list.cdr;
+            if (head->kind == O_IDENT && head->eval && !_lookup(s, e, head, &depth, &slot, &fixed)) {
+                if (_is_form(e, head, idents.lambda, SF_LAMBDA) && _lambda_form_ok(args))
+                    return _resolve_lambda(s, e, args->list.car, args->list.cdr->list.car);
+
+                if (_is_form(e, head, idents.let, SF_LET) && _let_form_ok(args))
+                    return _resolve_let(s, e, args->list.car, args->list.cdr->list.car, false);
+
+                if (_is_form(e, head, idents.loop, SF_LOOP) && _let_form_ok(args))
+                    return _resolve_let(s, e, args->list.car, args->list.cdr->list.car, true);
+
+                /* the name being defined isn't a reference */
+                if (IDENT_EQ(head, idents.def) && args->kind == O_LIST && args->list.cdr->kind == O_LIST) {
+                    Object *prev = defining;
+                    defining = args->list.car->kind == O_IDENT ? args->list.car : NULL;
+                    Object *value = _resolve_list(s, e, args->list.cdr);
+                    defining = prev;
+                    Object *ret = object_list_new(head, object_list_new(args->list.car, value));
+                    ret->list.cdr->eval = args->eval;
+                    return ret;
+                }
+            }
+
+            return _resolve_list(s, e, o);
+        } break;
+
+        default:
+            return o;
+    }
+}
+
+Object *resolve_lambda(Env *e, Object *arguments, Object *body)
+{
+    _init_idents();
+    runtime_may_def = _frames_have_defs(e);
+    return _resolve_lambda(NULL, e, arguments, body);
+}
+
+Object *resolve_let(Env *e, Object *bindings, Object *body, bool loop)
+{
+    _init_idents();
+    runtime_may_def = _frames_have_defs(e);
+    return _resolve_let(NULL, e, bindings, body, loop);
+}
+
+Object *resolve_expr(Env *e, Object *o)
+{
+    _init_idents();
+    /* o runs in e, so what it defs goes in e */
+    runtime_may_def = _frames_have_defs(e) || (e->scope && _may_def(e, o));
+    return resolve_wrap(o, _resolve(NULL, e, o));
+}
+
+Object *resolve_wrap(Object *body, Object *resolved)
+{
+    struct Lambda *lambda = malloc(sizeof(struct Lambda));
+    CHECK_ALLOC(lambda);
+    *lambda = (struct Lambda) {
+        .arguments = object_nil_new(),
+        .body = body,
+        .resolved = resolved,
+        .required = 0,
+        .variadic = false,
+        .slot_count = 0,
+        .flat = false,
+        .capture_count = 0,
+        .captures = NULL,
+        .capture_names = NULL,
+        .code = NULL,
+    };
+
+    Object *ret = object_new_generic();
+    ret->kind = O_LAMBDA;
+    ret->lambda = lambda;
+    return ret;
+}
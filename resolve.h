@@ -0,0 +1,40 @@
+#ifndef RESOLVE_HEADER__
+#define RESOLVE_HEADER__
+
+#include "object.h"
+
+/* The resolver runs once when a lambda or a let is created. It turns every
+ * reference to a lambda parameter or let binding into an O_LOCAL, a
+ * (depth, slot) address into the chain of frames, so a frame can be a flat
+ * array of slots instead of a tree of names. Nested \ and let forms become
+ * O_LAMBDA and O_LET objects so they aren't resolved again every time they
+ * are evaluated.
+ *
+ * Identifiers that aren't lexically bound are left alone and looked up by
+ * name at runtime (globals, and anything def'd or load'ed into a frame).
+ * \, let, loop and def are recognised by name, as long as they aren't
+ * shadowed by a local. A loop is resolved like a let.
+ *
+ * Lambdas are flat closures where possible: the variables a lambda uses
+ * from the scopes around it are captured, and when it's made their values
+ * are copied into a frame of their own (see env_new_closure) that sits
+ * right on top of the global environment. So a lambda only keeps alive
+ * what it uses, not every frame it was made in. A lambda closes over the
+ * whole environment instead when it might see a binding change: when it
+ * captures a let binding that isn't bound yet where it's made (a function
+ * calling itself through its let binding) or that is bound again after,
+ * or when something might be def'd into a frame it's made in. */
+
+/* arguments must already be validated, see _builtin_lambda */
+Object *resolve_lambda(Env *e, Object *arguments, Object *body);
+/* bindings must already be validated, see _builtin_let */
+Object *resolve_let(Env *e, Object *bindings, Object *body, bool loop);
+/* resolves an expression to be run directly in e (top level forms, eval)
+ * as a lambda without any parameters. Unlike calling a lambda, running it
+ * with vm_execute doesn't make a new frame, so def still defines in e */
+Object *resolve_expr(Env *e, Object *o);
+/* the lambda resolve_expr makes, around an expression that's already
+ * resolved (body is what it was resolved from) */
+Object *resolve_wrap(Object *body, Object *resolved);
+
+#endif
@@ -16,3 +16,14 @@ Object *doom(Env *e, Object *o)
 
     return object_nil_new();
 }
+
+// primitives get their arguments evaluated, and only get called with as
+// many as they ask for. They're exported as a PrimitiveDef named
+// <function name>_primitive, so this is imported with
+// (import-shared "shared.so" "pair")
+static Object *_pair(Object **argv, size_t argc)
+{
+    return object_with_eval(object_list_new(argv[0], object_list_new(argv[1], object_nil_new())), false);
+}
+
+const PrimitiveDef pair_primitive = { "pair", _pair, 2, 2, PRIM_PURE };
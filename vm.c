@@ -0,0 +1,453 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "vm.h"
+#include "compile.h"
+#include "environment.h"
+#include "eval.h"
+#include "util.h"
+
+typedef struct {
+    Object *lambda; /* O_LAMBDA, keeps the code alive */
+    size_t pc;
+    Env *env;
+    size_t frames; /* the frame stack's size before the call, see env_push_frame */
+} CallFrame;
+
+static struct {
+    struct { size_t len, capacity; Object **ptr; } stack;
+    struct { size_t len, capacity; CallFrame *ptr; } frames;
+} vm = {
+    .stack = { 0, 0, NULL },
+    .frames = { 0, 0, NULL },
+};
+
+#define VM_DEFAULT_STACK_SIZE 1024
+#define VM_DEFAULT_FRAMES 256
+
+static inline void _push(Object *o)
+{
+    if (vm.stack.capacity == 0) {
+        vm.stack.capacity = VM_DEFAULT_STACK_SIZE;
+        vm.stack.ptr = malloc(sizeof(Object *) * vm.stack.capacity);
+        CHECK_ALLOC(vm.stack.ptr);
+    }
+    da_append(vm.stack, o);
+}
+
+static inline Object *_pop(void)
+{
+    assert(vm.stack.len > 0);
+    return vm.stack.ptr[--vm.stack.len];
+}
+
+static inline Object *_peek(void)
+{
+    return vm.stack.ptr[vm.stack.len - 1];
+}
+
+static inline void _push_frame(Object *lambda, Env *env, size_t frames)
+{
+    if (vm.frames.capacity == 0) {
+        vm.frames.capacity = VM_DEFAULT_FRAMES;
+        vm.frames.ptr = malloc(sizeof(CallFrame) * vm.frames.capacity);
+        CHECK_ALLOC(vm.frames.ptr);
+    }
+    da_append(vm.frames, ((CallFrame) { .lambda = lambda, .pc = 0, .env = env, .frames = frames }));
+}
+
+/* the binding of a global, from the call site's cache if nothing was
+ * def'd since it was filled. NULL if it has to be looked up the slow way:
+ * a frame in between has defs, or it isn't bound in the global environment */
+static inline EnvBinding *_global_binding(Env *env, Object *ident, struct InlineCache *cache)
+{
+    Env *globals = env;
+    for (; globals && globals->scope; globals = globals->parent)
+        if (globals->store) return NULL;
+    if (cache->version == env_version && cache->globals == globals) return cache->binding;
+
+    EnvBinding *binding = env_global_binding(env, ident);
+    if (binding) *cache = (struct InlineCache) { .version = env_version, .globals = globals, .binding = binding };
+    return binding;
+}
+
+/* the argc values on top of the stack are f's arguments */
+static inline Object *_call_primitive(Object *f, size_t argc)
+{
+    const PrimitiveDef *prim = f->prim;
+    if (argc < prim->min_args)
+        object_error_new("too few arguments passed to %sc", prim->name);
+    if (argc > prim->max_args)
+        object_error_new("too many arguments passed to %sc", prim->name);
+    return prim->fn(&vm.stack.ptr[vm.stack.len - argc], argc);
+}
+
+static inline struct Code *_code_of(Env *e, Object *lambda)
+{
+    if (lambda->lambda->code == NULL) compile_lambda(e, lambda);
+    return lambda->lambda->code;
+}
+
+/* a call of apply with a lambda, (apply g xs), is turned into (g x1 x2 ...)
+ * on the stack. That way the vm makes the call itself, instead of it
+ * recursing through vm_prim_apply, and it can be a tail call. Returns the
+ * function to call with the new argc */
+static inline Object *_spread_apply(Object *f, size_t *argc)
+{
+    if (f->kind != O_BUILTIN || f->prim == NULL || f->prim->fn != vm_prim_apply || *argc != 2)
+        return f;
+    Object *g = vm.stack.ptr[vm.stack.len - 2];
+    Object *xs = vm.stack.ptr[vm.stack.len - 1];
+    if (g->kind != O_FUNCTION) return f;
+
+    vm.stack.len -= 3;
+    _push(g);
+    size_t count = 0;
+    for (; xs->kind == O_LIST; xs = xs->list.cdr, count++) _push(xs->list.car);
+    if (xs->kind != O_NIL) object_error_new("apply: expected list, got %sc", object_type_as_string(xs->kind));
+    *argc = count;
+    return g;
+}
+
+/* builds the frame for a call of f with the argc values on top of the stack */
+static Env *_bind_arguments(Object *f, size_t argc, Object *name /* nullable */)
+{
+    struct Lambda *lambda = f->function.lambda->lambda;
+    if (argc < lambda->required || (!lambda->variadic && argc > lambda->required)) {
+        if (name == NULL) name = object_string_slice_new_cstr("<anonymous>");
+        if (argc < lambda->required) object_error_new("function %s passed too few values", name);
+        object_error_new("function %s passed too many values", name);
+    }
+
+    Env *env = env_push_frame(f->function.env, f->function.lambda);
+    Object **args = &vm.stack.ptr[vm.stack.len - argc];
+    for (size_t i = 0; i < lambda->required; i++)
+        env->slots[i] = args[i];
+
+    if (lambda->variadic) {
+        /* give it an empty list if there are no variadic args */
+        Object *rest = object_nil_new();
+        for (size_t i = argc; i-- > lambda->required;)
+            rest = object_list_new(args[i], rest);
+        if (rest->kind == O_LIST) rest->eval = false;
+        env->slots[lambda->required] = rest;
+    }
+
+    return env;
+}
+
+Object *vm_execute(Env *e, Object *lambda)
+{
+    size_t base = vm.frames.len;
+    /* e belongs to the caller, only the lets run in it are popped */
+    _push_frame(lambda, e, env_frame_count());
+
+    Env *env = e;
+    struct Code *code = _code_of(e, lambda);
+    Instr *instrs = code->instrs;
+    Object **constants = code->constants;
+    size_t pc = 0;
+    /* function calls are the gc's safe points, everything live is either
+     * on the vm's stacks or rooted by whoever called into the vm */
+    GC_maybe_collect(NULL);
+
+    for (;;) {
+        switch ((enum Opcode)instrs[pc++]) {
+            case OP_CONST:
+                _push(constants[instrs[pc++]]);
+                break;
+
+            case OP_NIL:
+                _push(object_nil_new());
+                break;
+
+            case OP_LOCAL: {
+                uint32_t depth = instrs[pc++];
+                uint32_t slot = instrs[pc++];
+                Object *ident = constants[instrs[pc++]];
+                Object *value = depth == 0 ? env->slots[slot] : NULL;
+                _push(value ? value : env_get_local(env, depth, slot, ident));
+            } break;
+
+            case OP_GLOBAL: {
+                Object *ident = constants[instrs[pc++]];
+                EnvBinding *binding = _global_binding(env, ident, &code->caches[instrs[pc++]]);
+                _push(binding ? binding->value : env_get(env, ident));
+            } break;
+
+            case OP_SET_LOCAL:
+                env->slots[instrs[pc++]] = _pop();
+                GC_env_write_barrier(env);
+                break;
+
+            case OP_POP:
+                (void)_pop();
+                break;
+
+            case OP_JUMP:
+                pc = instrs[pc];
+                break;
+
+            case OP_JUMP_IF_NIL: {
+                Instr target = instrs[pc++];
+                if (_pop()->kind == O_NIL) pc = target;
+            } break;
+
+            case OP_JUMP_IF_NIL_ELSE_POP: {
+                Instr target = instrs[pc++];
+                if (_peek()->kind == O_NIL) pc = target;
+                else (void)_pop();
+            } break;
+
+            case OP_JUMP_UNLESS_NIL_ELSE_POP: {
+                Instr target = instrs[pc++];
+                if (_peek()->kind != O_NIL) pc = target;
+                else (void)_pop();
+            } break;
+
+            case OP_CLOSURE:
+                _push(object_function_new(env, constants[instrs[pc++]]));
+                break;
+
+            case OP_LET_ENTER:
+                env = env_push_frame(env, constants[instrs[pc++]]);
+                vm.frames.ptr[vm.frames.len - 1].env = env;
+                break;
+
+            case OP_LET_EXIT:
+                env = env->parent;
+                env_pop_frames(env_frame_count() - 1);
+                vm.frames.ptr[vm.frames.len - 1].env = env;
+                break;
+
+            case OP_RECUR: {
+                Object *loop = constants[instrs[pc++]];
+                uint32_t lets = instrs[pc++];
+                for (uint32_t i = 0; i < lets; i++) env = env->parent;
+                env_pop_frames(env_frame_count() - lets);
+
+                /* the slots are rebound in place, unless something might
+                 * still see the old ones. Then it gets a new frame */
+                if (env->escaped || env->store) {
+                    env = env->parent;
+                    env_pop_frames(env_frame_count() - 1);
+                    env = env_push_frame(env, loop);
+                }
+                struct Let *let = loop->let;
+                Object **values = &vm.stack.ptr[vm.stack.len - let->binding_count];
+                for (size_t i = 0; i < let->binding_count; i++)
+                    env->slots[let->binding_slots[i]] = values[i];
+                GC_env_write_barrier(env);
+                vm.stack.len -= let->binding_count;
+                vm.frames.ptr[vm.frames.len - 1].env = env;
+                /* a loop might not call anything, so it's a safe point too */
+                GC_maybe_collect(NULL);
+            } break;
+
+            case OP_DEF: {
+                Object *name = constants[instrs[pc++]];
+                Object *value = _pop();
+                env_put(env, name, value);
+                _push(object_list_new(name, object_list_new(value, object_nil_new())));
+            } break;
+
+            case OP_PREPARE_CALL: {
+                Object *args = constants[instrs[pc++]];
+                Instr target = instrs[pc++];
+                Object *f = _peek();
+                if (f->kind == O_BUILTIN && f->builtin) {
+                    (void)_pop();
+                    vm.frames.ptr[vm.frames.len - 1].pc = pc;
+                    _push(f->builtin(env, args));
+                    pc = target;
+                } else if (f->kind != O_FUNCTION && f->kind != O_BUILTIN) {
+                    object_error_new("invalid function call, expected function got %sc", object_type_as_string(f->kind));
+                }
+            } break;
+
+            case OP_CALL: {
+                size_t argc = instrs[pc++];
+                Object *name = constants[instrs[pc++]];
+                Object *f = vm.stack.ptr[vm.stack.len - argc - 1];
+                Object *applied = _spread_apply(f, &argc);
+                if (applied != f) {
+                    f = applied;
+                    name = NULL;
+                }
+                if (f->kind == O_BUILTIN) {
+                    Object *ret = _call_primitive(f, argc);
+                    vm.stack.len -= argc + 1;
+                    _push(ret);
+                    break;
+                }
+                size_t frames = env_frame_count();
+                Env *frame = _bind_arguments(f, argc, name);
+                vm.stack.len -= argc + 1;
+
+                vm.frames.ptr[vm.frames.len - 1].pc = pc;
+                _push_frame(f->function.lambda, frame, frames);
+
+                env = frame;
+                code = _code_of(env, f->function.lambda);
+                instrs = code->instrs;
+                constants = code->constants;
+                pc = 0;
+                GC_maybe_collect(NULL);
+            } break;
+
+            case OP_TAIL_CALL: {
+                /* nothing of the current frame is left on the stack in tail
+                 * position, so the frame can just be replaced */
+                size_t argc = instrs[pc++];
+                Object *name = constants[instrs[pc++]];
+                Object *f = vm.stack.ptr[vm.stack.len - argc - 1];
+                Object *applied = _spread_apply(f, &argc);
+                if (applied != f) {
+                    f = applied;
+                    name = NULL;
+                }
+                if (f->kind == O_BUILTIN) {
+                    /* like a Builtin, the code after it returns the value */
+                    Object *ret = _call_primitive(f, argc);
+                    vm.stack.len -= argc + 1;
+                    _push(ret);
+                    break;
+                }
+                size_t frames = vm.frames.ptr[vm.frames.len - 1].frames;
+                env_pop_frames(frames);
+                Env *frame = _bind_arguments(f, argc, name);
+                vm.stack.len -= argc + 1;
+
+                vm.frames.ptr[vm.frames.len - 1] = (CallFrame) {
+                    .lambda = f->function.lambda,
+                    .pc = 0,
+                    .env = frame,
+                    .frames = frames,
+                };
+
+                env = frame;
+                code = _code_of(env, f->function.lambda);
+                instrs = code->instrs;
+                constants = code->constants;
+                pc = 0;
+                GC_maybe_collect(NULL);
+            } break;
+
+            case OP_GUARD: {
+                Object *name = constants[instrs[pc++]];
+                EnvBinding *binding = _global_binding(env, name, &code->caches[instrs[pc++]]);
+                Object *expected = constants[instrs[pc++]];
+                Instr target = instrs[pc++];
+                Object *value = binding ? binding->value : env_lookup(env, name);
+                if (value == NULL || value->kind != O_BUILTIN || value->prim != expected->prim
+                        || value->builtin != expected->builtin)
+                    pc = target;
+            } break;
+
+            case OP_PRIM: {
+                Object *prim = constants[instrs[pc++]];
+                size_t argc = instrs[pc++];
+                Object *ret = prim->prim->fn(&vm.stack.ptr[vm.stack.len - argc], argc);
+                vm.stack.len -= argc;
+                _push(ret);
+            } break;
+
+            case OP_EVAL: {
+                Object *form = constants[instrs[pc++]];
+                vm.frames.ptr[vm.frames.len - 1].pc = pc;
+                _push(eval_expr(env, form));
+            } break;
+
+            case OP_RETURN: {
+                env_pop_frames(vm.frames.ptr[vm.frames.len - 1].frames);
+                vm.frames.len--;
+                if (vm.frames.len == base) return _pop();
+
+                CallFrame *frame = &vm.frames.ptr[vm.frames.len - 1];
+                env = frame->env;
+                code = frame->lambda->lambda->code;
+                instrs = code->instrs;
+                constants = code->constants;
+                pc = frame->pc;
+            } break;
+        }
+    }
+}
+
+/* calls f with the argc values on top of the stack, and pops them */
+static Object *_call_values(Object *f, size_t argc)
+{
+    size_t base = vm.stack.len - argc;
+    Object *ret;
+
+    if (f->kind == O_BUILTIN && f->prim) {
+        ret = _call_primitive(f, argc);
+    } else if (f->kind == O_BUILTIN) {
+        /* the values evaluate to themselves, so it gets them as if they
+         * were written out in a call */
+        Object *args = object_nil_new();
+        for (size_t i = vm.stack.len; i-- > base;) args = object_list_new(vm.stack.ptr[i], args);
+        Env *e = vm.frames.len > 0 ? vm.frames.ptr[vm.frames.len - 1].env : NULL;
+        ret = f->builtin(e, args);
+    } else if (f->kind == O_FUNCTION) {
+        size_t frames = env_frame_count();
+        Env *frame = _bind_arguments(f, argc, NULL);
+        vm.stack.len = base;
+        ret = vm_execute(frame, f->function.lambda);
+        env_pop_frames(frames);
+    } else {
+        ret = object_error_new("invalid function call, expected function got %sc", object_type_as_string(f->kind));
+    }
+
+    vm.stack.len = base;
+    return ret;
+}
+
+Object *vm_call(Object *f, Object **argv, size_t argc)
+{
+    for (size_t i = 0; i < argc; i++) _push(argv[i]);
+    return _call_values(f, argc);
+}
+
+Object *vm_prim_apply(Object **argv, size_t argc)
+{
+    Object *f = argv[0], *xs = argv[1];
+    size_t base = vm.stack.len;
+    for (; xs->kind == O_LIST; xs = xs->list.cdr) _push(xs->list.car);
+    if (xs->kind != O_NIL) object_error_new("apply: expected list, got %sc", object_type_as_string(xs->kind));
+    return _call_values(f, vm.stack.len - base);
+}
+
+Object *vm_apply_primitive(Env *e, Object *f, Object *args)
+{
+    size_t base = vm.stack.len;
+    for (; args->kind == O_LIST; args = args->list.cdr)
+        _push(eval_expr(e, args->list.car));
+    if (args->kind != O_NIL) object_error_new("invalid function call form");
+
+    Object *ret = _call_primitive(f, vm.stack.len - base);
+    vm.stack.len = base;
+    return ret;
+}
+
+VMState vm_save(void)
+{
+    return (VMState) { .stack_len = vm.stack.len, .frame_count = vm.frames.len, .env_frames = env_frame_count() };
+}
+
+void vm_restore(VMState state)
+{
+    vm.stack.len = state.stack_len;
+    vm.frames.len = state.frame_count;
+    env_pop_frames(state.env_frames);
+}
+
+void vm_mark_roots(void)
+{
+    for (size_t i = 0; i < vm.stack.len; i++)
+        GC_mark_object(vm.stack.ptr[i]);
+
+    for (size_t i = 0; i < vm.frames.len; i++) {
+        GC_mark_object(vm.frames.ptr[i].lambda);
+        GC_mark_env(vm.frames.ptr[i].env);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef VM_HEADER__
+#define VM_HEADER__
+
+#include "object.h"
+
+/* The virtual machine runs the bytecode made by the compiler (see
+ * compile.h). Calls between lambdas push a frame onto the vm's own frame
+ * stack instead of recursing in C, builtins are called directly. A call in
+ * tail position replaces the caller's frame, so recursive loops run in
+ * constant space. */
+
+/* runs the code of lambda with e as its frame, lambda is compiled first
+ * if it hasn't been already */
+Object *vm_execute(Env *e, Object *lambda);
+/* calls the function, or any kind of builtin, f with the values in argv
+ * (which can't point into the vm's stack). For the natives that take
+ * functions, like map */
+Object *vm_call(Object *f, Object **argv, size_t argc);
+/* the apply primitive, (apply f xs) calls f with the values in xs without
+ * evaluating them again. Calls of it in code are made by the vm directly */
+Object *vm_prim_apply(Object **argv, size_t argc);
+/* calls the primitive f (see PrimitiveDef) with the unevaluated args, they
+ * are evaluated onto the vm's stack so the gc sees them */
+Object *vm_apply_primitive(Env *e, Object *f, Object *args);
+
+/* the vm's stacks (and the frame stack, see env_push_frame) have to be put
+ * back where they were when an error longjmps out of it, see eval() */
+typedef struct { size_t stack_len, frame_count, env_frames; } VMState;
+VMState vm_save(void);
+void vm_restore(VMState state);
+
+/* marks everything on the vm's stacks, called by the garbage collector */
+void vm_mark_roots(void);
+
+#endif
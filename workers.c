@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "workers.h"
+#include "util.h"
+
+typedef struct {
+    void (*free_fn)(void *);
+    void *ptr;
+} DeferredFree;
+
+typedef struct {
+    size_t len, capacity;
+    DeferredFree *ptr;
+} DeferredFreeVec;
+
+static struct {
+    size_t count;
+    bool started;
+
+    /* the pool, a job is started by bumping generation */
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    size_t generation;
+    size_t running; /* threads that haven't finished the job yet */
+    void (*job)(size_t id, void *arg);
+    void *arg;
+    size_t jobs;
+
+    /* the background thread takes the whole queue at once. Without it
+     * (it couldn't be started) frees are done right away */
+    bool background_frees;
+    pthread_mutex_t free_lock;
+    pthread_cond_t free_wake;
+    DeferredFreeVec batch; /* only touched by the main thread */
+    DeferredFreeVec queue;
+    size_t deferred_frees;
+} workers = {
+    .count = 1,
+    .started = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .generation = 0,
+    .running = 0,
+    .job = NULL,
+    .arg = NULL,
+    .jobs = 0,
+    .background_frees = false,
+    .free_lock = PTHREAD_MUTEX_INITIALIZER,
+    .free_wake = PTHREAD_COND_INITIALIZER,
+    .batch = { 0, 0, NULL },
+    .queue = { 0, 0, NULL },
+    .deferred_frees = 0,
+};
+
+static void *_worker_main(void *p)
+{
+    size_t id = (size_t)p;
+    size_t seen = 0;
+
+    pthread_mutex_lock(&workers.lock);
+    for (;;) {
+        while (workers.generation == seen)
+            pthread_cond_wait(&workers.start, &workers.lock);
+        seen = workers.generation;
+        pthread_mutex_unlock(&workers.lock);
+
+        workers.job(id, workers.arg);
+
+        pthread_mutex_lock(&workers.lock);
+        if (--workers.running == 0) pthread_cond_signal(&workers.done);
+    }
+    return NULL;
+}
+
+static void *_sweeper_main(void *p)
+{
+    (void)p;
+    pthread_mutex_lock(&workers.free_lock);
+    for (;;) {
+        while (workers.queue.len == 0)
+            pthread_cond_wait(&workers.free_wake, &workers.free_lock);
+        DeferredFreeVec frees = workers.queue;
+        workers.queue = (DeferredFreeVec) { 0, 0, NULL };
+        pthread_mutex_unlock(&workers.free_lock);
+
+        for (size_t i = 0; i < frees.len; i++)
+            frees.ptr[i].free_fn(frees.ptr[i].ptr);
+        free(frees.ptr);
+
+        pthread_mutex_lock(&workers.free_lock);
+    }
+    return NULL;
+}
+
+/* a thread that can't be started is left out, the gc carries on with the
+ * ones that did start (just the calling thread if none did) */
+static void _workers_start(void)
+{
+    pthread_t thread;
+    for (size_t id = 1; id < workers.count; id++) {
+        int err = pthread_create(&thread, NULL, _worker_main, (void *)id);
+        if (err != 0) {
+            fprintf(stderr, "couldn't start gc thread %zu (%s), marking with %zu thread%s\n",
+                    id, strerror(err), id, id == 1 ? "" : "s");
+            workers.count = id;
+            break;
+        }
+        pthread_detach(thread);
+    }
+
+    int err = pthread_create(&thread, NULL, _sweeper_main, NULL);
+    if (err != 0) {
+        fprintf(stderr, "couldn't start the background free thread (%s), freeing right away\n",
+                strerror(err));
+    } else {
+        pthread_detach(thread);
+        workers.background_frees = true;
+    }
+    workers.started = true;
+}
+
+void workers_set_count(size_t count)
+{
+    assert(count >= 1);
+    assert(!workers.started && "the gc threads can only be set up once");
+    workers.count = count;
+    if (count > 1) _workers_start();
+}
+
+size_t workers_count(void)
+{
+    return workers.count;
+}
+
+void workers_run(void (*job)(size_t id, void *arg), void *arg)
+{
+    workers.jobs++;
+    if (workers.count == 1) {
+        job(0, arg);
+        return;
+    }
+
+    pthread_mutex_lock(&workers.lock);
+    workers.job = job;
+    workers.arg = arg;
+    workers.running = workers.count - 1;
+    workers.generation++;
+    pthread_cond_broadcast(&workers.start);
+    pthread_mutex_unlock(&workers.lock);
+
+    job(0, arg);
+
+    pthread_mutex_lock(&workers.lock);
+    while (workers.running > 0)
+        pthread_cond_wait(&workers.done, &workers.lock);
+    pthread_mutex_unlock(&workers.lock);
+}
+
+void workers_defer_free(void (*free_fn)(void *), void *ptr)
+{
+    if (!workers.background_frees) {
+        free_fn(ptr);
+        return;
+    }
+
+    if (workers.batch.capacity == 0) {
+        workers.batch.capacity = 256;
+        workers.batch.ptr = malloc(sizeof(DeferredFree) * workers.batch.capacity);
+        CHECK_ALLOC(workers.batch.ptr);
+    }
+    da_append(workers.batch, ((DeferredFree) { .free_fn = free_fn, .ptr = ptr }));
+    workers.deferred_frees++;
+}
+
+void workers_flush(void)
+{
+    if (workers.batch.len == 0) return;
+
+    pthread_mutex_lock(&workers.free_lock);
+    if (workers.queue.len == 0) {
+        /* the usual case, the last batch is done with */
+        free(workers.queue.ptr);
+        workers.queue = workers.batch;
+        workers.batch = (DeferredFreeVec) { 0, 0, NULL };
+    } else {
+        for (size_t i = 0; i < workers.batch.len; i++)
+            da_append(workers.queue, workers.batch.ptr[i]);
+        workers.batch.len = 0;
+    }
+    pthread_cond_signal(&workers.free_wake);
+    pthread_mutex_unlock(&workers.free_lock);
+}
+
+void workers_debug_print_status(void)
+{
+    if (workers.count == 1 && !workers.background_frees) return;
+    fprintf(stderr, "\tgc threads: %zu, %zu parallel jobs, %zu frees done in the background\n",
+            workers.count, workers.jobs, workers.deferred_frees);
+}
@@ -0,0 +1,30 @@
+#ifndef WORKERS_HEADER__
+#define WORKERS_HEADER__
+
+#include <stddef.h>
+
+/* Helper threads for the garbage collector. There's a pool of threads that
+ * workers_run starts a job on, the calling thread counts as the first one.
+ * And a background thread that does the frees handed to workers_defer_free,
+ * so the gc doesn't have to wait for free() while sweeping.
+ *
+ * With a count of 1 (the default) there are no threads, jobs run on the
+ * calling thread and frees are done right away. */
+
+/* the number of threads to mark with, including the calling one. The
+ * threads are started the first time it's more than 1 */
+void workers_set_count(size_t count);
+size_t workers_count(void);
+/* runs job(id, arg) on every thread, with ids 0 to count - 1, and waits
+ * for all of them to return. Only called from the main thread */
+void workers_run(void (*job)(size_t id, void *arg), void *arg);
+
+/* the frees are batched up, workers_flush hands the batch to the
+ * background thread. free_fn must not touch the heap (see heap.h), it's
+ * not thread safe */
+void workers_defer_free(void (*free_fn)(void *), void *ptr);
+void workers_flush(void);
+
+void workers_debug_print_status(void);
+
+#endif